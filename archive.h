@@ -0,0 +1,1333 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bit_handler.h"
+#include "codec.h"
+#include "crc32c.h"
+#include "fingerprint.h"
+#include "huffman_coding.h"
+#include "mapped_file.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+// Archive layout, all integers little-endian:
+//   "HFAR" version:u8 dictionary_id:u32 (0 when blocks use no dictionary)
+//   record*: 'M' name_length:u16 name block_stream
+//          | 'S' files_count:u32 (shared_prefix:var suffix_length:var suffix size:var)* block_stream
+//          | 'L' name_length:u16 name target:u32
+//   'E'
+//   index: members_count:u32 (name_length:u16 name original_size:u64 offset:u64 position:u64 checksum:u32)*
+//   index_offset:u64 "HFIX"
+// where a block stream is the format of codec.h and var is a LEB128 varint.
+// Members and blocks start on byte boundaries and every block carries its own code table. A solid group ('S') codes
+// the files it lists as one stream, so small files share blocks and tables; every name shares a prefix with the name
+// before it. The index gives the offset of the record holding every member, its position in the stream of a solid
+// group (0 for a member record) and the CRC-32C of its original data, and the fixed-size trailer lets a seekable
+// reader find the index without touching the members.
+// Deduplicated archives hold two kinds of copies. A link ('L') restores the member with index target, in the order
+// of the records, under another name. A block of a member record may be raw_size:u32 0xFFFFFFFF source_offset:u64,
+// which repeats the block of an earlier member starting at source_offset. Both point back to data that is no copy.
+// Appending writes new records over the end marker, index and trailer and ends with an index of all members.
+const char ARCHIVE_MAGIC[] = "HFAR";
+const char INDEX_MAGIC[] = "HFIX";
+const int32_t ARCHIVE_MAGIC_SIZE = 4;
+const int32_t ARCHIVE_HEADER_SIZE = ARCHIVE_MAGIC_SIZE + 1 + 4;
+const int32_t TRAILER_SIZE = 8 + ARCHIVE_MAGIC_SIZE;
+const uint8_t ARCHIVE_VERSION = 10;
+const char MEMBER_TAG = 'M';
+const char SOLID_TAG = 'S';
+const char LINK_TAG = 'L';
+const uint32_t REFERENCE_PAYLOAD_SIZE = UINT32_MAX;
+// A smaller file of a solid group costs less in the group than a link with its full name would.
+const uint64_t MIN_SOLID_COPY_SIZE = 256;
+const char ARCHIVE_END_TAG = 'E';
+// Dictionary file: "HFDT" version:u8 code_length:u8[256]
+const char DICTIONARY_MAGIC[] = "HFDT";
+const uint8_t DICTIONARY_VERSION = 1;
+
+inline void SaveDictionary(const Dictionary &dictionary, std::string filename) {
+    FileWriter file_writer(filename);
+    file_writer.Write(DICTIONARY_MAGIC, ARCHIVE_MAGIC_SIZE);
+    file_writer.WriteNext(static_cast<char>(DICTIONARY_VERSION));
+    for (int32_t symbol = 0; symbol < DICTIONARY_SYMBOLS_COUNT; ++symbol) {
+        file_writer.WriteNext(static_cast<char>(dictionary.GetCodeLengths()[symbol]));
+    }
+    file_writer.Close();
+}
+
+inline Dictionary LoadDictionary(std::string filename) {
+    MappedReader reader(filename);
+    const unsigned char *data = nullptr;
+    size_t size = ARCHIVE_MAGIC_SIZE + 1 + DICTIONARY_SYMBOLS_COUNT;
+    if (reader.Read(data, size) != size or
+        not std::equal(DICTIONARY_MAGIC, DICTIONARY_MAGIC + ARCHIVE_MAGIC_SIZE, data) or
+        data[ARCHIVE_MAGIC_SIZE] != DICTIONARY_VERSION) {
+        throw ArchiveException(filename + " is not a dictionary");
+    }
+    SymbolLengths code_length{};
+    std::vector<std::pair<int16_t, int16_t>> lengths_and_symbols;
+    for (int32_t symbol = 0; symbol < DICTIONARY_SYMBOLS_COUNT; ++symbol) {
+        code_length[symbol] = data[ARCHIVE_MAGIC_SIZE + 1 + symbol];
+        if (code_length[symbol] < 1 or code_length[symbol] > MAX_CODE_LENGTH) {
+            throw ArchiveException("Corrupted dictionary " + filename);
+        }
+        lengths_and_symbols.emplace_back(code_length[symbol], symbol);
+    }
+    if (not IsPrefixCode(lengths_and_symbols)) {
+        throw ArchiveException("Corrupted dictionary " + filename);
+    }
+    return Dictionary(code_length);
+}
+
+struct MemberInfo {
+    std::string name;
+    uint64_t original_size = 0;
+    uint64_t offset = 0;
+    uint64_t position = 0;
+    uint32_t checksum = 0;
+};
+
+template <typename Writer>
+void WriteVarint(Writer &writer, uint64_t value) {
+    for (; value >= 0x80; value >>= 7) {
+        writer.WriteNext(static_cast<char>(0x80 | (value & 0x7F)));
+    }
+    writer.WriteNext(static_cast<char>(value));
+}
+
+// Blocks are encoded on the thread pool into records of their own; the records leave in submission order, so the
+// archive does not depend on the number of threads. At most a few blocks per thread are in flight at once. The
+// records are written by the writer thread of the archive's FileWriter, so coding goes on while they are written.
+// Copies are found on the calling thread, in the same order, so deduplication keeps the archive independent of the
+// number of threads too.
+class ArchiveWriter {
+public:
+    ArchiveWriter(std::string filename, size_t block_size, const CodingOptions &options, size_t threads_count = 1,
+                  size_t pipeline_buffer_size = DEFAULT_PIPELINE_BUFFER_SIZE)
+        : file_writer_(filename, pipeline_buffer_size),
+          block_size_(block_size),
+          pipeline_buffer_size_(pipeline_buffer_size),
+          options_(options),
+          max_pending_records_(2 * threads_count + 1),
+          thread_pool_(threads_count > 1 ? threads_count : 0) {
+        file_writer_.Write(ARCHIVE_MAGIC, ARCHIVE_MAGIC_SIZE);
+        file_writer_.WriteNext(static_cast<char>(ARCHIVE_VERSION));
+        WriteInteger(file_writer_, options.dictionary != nullptr ? options.dictionary->GetId() : 0, 4);
+    }
+    // Appends to an archive with the given members whose records end at records_end: the new records replace its
+    // end marker, index and trailer, and Close writes an index of the old members and the new ones. The records of
+    // the old members are neither read nor rewritten. A writer destroyed before Close puts the old tail back, so an
+    // append that fails leaves the archive as it was.
+    ArchiveWriter(std::string filename, std::vector<MemberInfo> members, uint64_t records_end, size_t block_size,
+                  const CodingOptions &options, size_t threads_count = 1,
+                  size_t pipeline_buffer_size = DEFAULT_PIPELINE_BUFFER_SIZE)
+        : file_writer_(filename, pipeline_buffer_size, records_end),
+          block_size_(block_size),
+          pipeline_buffer_size_(pipeline_buffer_size),
+          options_(options),
+          max_pending_records_(2 * threads_count + 1),
+          members_(std::move(members)),
+          filename_(filename),
+          records_end_(records_end),
+          thread_pool_(threads_count > 1 ? threads_count : 0) {
+        MappedReader reader(filename);
+        reader.Seek(records_end);
+        const unsigned char *data = nullptr;
+        size_t size = reader.Read(data, reader.Size() - records_end);
+        old_tail_.assign(data, data + size);
+    }
+    ArchiveWriter(const ArchiveWriter &) = delete;
+    ArchiveWriter &operator=(const ArchiveWriter &) = delete;
+    ~ArchiveWriter() {
+        if (old_tail_.empty() or is_closed_) {
+            return;
+        }
+        // Nothing may escape a destructor, and the old tail has to be put back whatever stopped the writer.
+        try {
+            file_writer_.Close();
+        } catch (...) {
+        }
+        bool is_restored = false;
+        int fd = open(filename_.c_str(), O_WRONLY);
+        if (fd >= 0) {
+            is_restored = pwrite(fd, old_tail_.data(), old_tail_.size(), records_end_) ==
+                              static_cast<ssize_t>(old_tail_.size()) and
+                          ftruncate(fd, records_end_ + old_tail_.size()) == 0;
+            close(fd);
+        }
+        if (not is_restored) {
+            std::cerr << "Cannot restore the end of " << filename_ << ", the archive is damaged" << std::endl;
+        }
+    }
+    // Makes a regular file that repeats an earlier one a link to it, and a block of a member record that repeats a
+    // block of an earlier member a reference to that block, so that neither is coded again.
+    void SetDeduplication(bool deduplicate) {
+        deduplicate_ = deduplicate;
+    }
+    void AddFile(std::string filename) {
+        if (filename.size() > UINT16_MAX) {
+            throw ArchiveException("File name is too long: " + filename);
+        }
+        auto reader = std::make_shared<MappedReader>(filename, pipeline_buffer_size_);
+        int64_t member_index = static_cast<int64_t>(members_.size());
+        int64_t copy = FindFileCopy(filename, *reader, member_index);
+        if (copy >= 0) {
+            AddLink(filename, copy);
+            return;
+        }
+        members_.push_back(MemberInfo{filename});
+        Statistics::AddFile(member_index, filename);
+        Record &member = AddRecord();
+        member.member_header = member_index;
+        member.bytes.WriteNext(MEMBER_TAG);
+        WriteInteger(member.bytes, filename.size(), 2);
+        member.bytes.Write(filename.data(), filename.size());
+
+        const unsigned char *data = nullptr;
+        for (uint64_t position = 0; size_t size = reader->Read(data, block_size_); position += size) {
+            if (reader->IsMapped()) {
+                int64_t fingerprint = -1;
+                if (deduplicate_) {
+                    uint64_t hash = FastHash(data, size);
+                    int64_t copy = FindCopy(block_copies_, hash, data, size);
+                    if (copy >= 0) {
+                        AddReference(copy, data, size, member_index);
+                        continue;
+                    }
+                    fingerprint =
+                        AddFingerprint(block_copies_, hash, Fingerprint{filename, position, size, member_index});
+                }
+                AddBlock(data, size, reader, {Segment{member_index, size}}, fingerprint);
+            } else {
+                auto copy = std::make_shared<std::vector<unsigned char>>(data, data + size);
+                AddBlock(copy->data(), size, copy, {Segment{member_index, size}});
+            }
+        }
+        WriteInteger(AddRecord().bytes, 0, 4);
+        WriteRecords(max_pending_records_);
+    }
+    // Adds the files in solid groups: every run of regular files becomes one stream cut into blocks regardless of
+    // where the files end, so a directory of small files costs a table per block instead of one per file. Anything
+    // else, such as "-" or a pipe, has no size known in advance and is added as a member of its own.
+    // With deduplication, the files that repeat an earlier one become links that follow the group.
+    void AddSolidFiles(const std::vector<std::string> &filenames) {
+        std::vector<std::string> group;
+        std::vector<uint64_t> sizes;
+        std::vector<std::pair<std::string, int64_t>> links;
+        auto add_group = [this, &group, &sizes, &links] {
+            AddSolidGroup(group, sizes);
+            for (const auto &[filename, target] : links) {
+                AddLink(filename, target);
+            }
+            group.clear();
+            sizes.clear();
+            links.clear();
+        };
+        for (const std::string &filename : filenames) {
+            struct stat file_stat;
+            if (filename != "-" and stat(filename.c_str(), &file_stat) == 0 and S_ISREG(file_stat.st_mode)) {
+                int64_t copy = -1;
+                if (deduplicate_ and static_cast<uint64_t>(file_stat.st_size) >= MIN_SOLID_COPY_SIZE) {
+                    MappedReader reader(filename);
+                    copy = FindFileCopy(filename, reader, static_cast<int64_t>(members_.size() + group.size()));
+                }
+                if (copy >= 0) {
+                    links.emplace_back(filename, copy);
+                } else {
+                    group.push_back(filename);
+                    sizes.push_back(file_stat.st_size);
+                }
+                continue;
+            }
+            add_group();
+            AddFile(filename);
+        }
+        add_group();
+    }
+    void Close() {
+        WriteInteger(AddRecord().bytes, ARCHIVE_END_TAG, 1);
+        WriteRecords(0);
+        uint64_t index_offset = file_writer_.Position();
+        WriteInteger(file_writer_, members_.size(), 4);
+        for (const MemberInfo &member : members_) {
+            WriteInteger(file_writer_, member.name.size(), 2);
+            file_writer_.Write(member.name.data(), member.name.size());
+            WriteInteger(file_writer_, member.original_size, 8);
+            WriteInteger(file_writer_, member.offset, 8);
+            WriteInteger(file_writer_, member.position, 8);
+            WriteInteger(file_writer_, member.checksum, 4);
+        }
+        WriteInteger(file_writer_, index_offset, 8);
+        file_writer_.Write(INDEX_MAGIC, ARCHIVE_MAGIC_SIZE);
+        file_writer_.Close();
+        if (not old_tail_.empty() and truncate(filename_.c_str(), file_writer_.Position()) != 0) {
+            throw FileException("Cannot truncate " + filename_);
+        }
+        is_closed_ = true;
+    }
+
+private:
+    // Part of a block that belongs to one member.
+    struct Segment {
+        int64_t member;
+        size_t size;
+        uint32_t checksum = 0;
+    };
+    // A record is a record header, a coded block or a reference, whose bytes are filled in once the block it
+    // repeats has been written. A block with a fingerprint is the first copy that later references point to, and a
+    // link takes the size and checksum of its target.
+    struct Record {
+        BufferWriter bytes;
+        std::future<void> encoded;
+        int64_t member_header = -1;
+        size_t header_members_count = 1;
+        std::vector<Segment> segments;
+        int64_t fingerprint = -1;
+        int64_t reference = -1;
+        int64_t link_target = -1;
+    };
+    // First copy of some content, found again through the fast hash of later candidates. The offset and checksum of
+    // a block are set once it has been written.
+    struct Fingerprint {
+        std::string filename;
+        uint64_t file_offset;
+        size_t size;
+        int64_t member;
+        uint64_t offset = 0;
+        uint32_t checksum = 0;
+    };
+    struct CopyTable {
+        std::unordered_multimap<uint64_t, size_t> hashes;
+        std::vector<Fingerprint> fingerprints;
+    };
+
+    Record &AddRecord() {
+        records_.push_back(std::make_unique<Record>());
+        return *records_.back();
+    }
+    // Queues a block for coding on the thread pool; owner keeps data alive until it is coded.
+    void AddBlock(const unsigned char *data, size_t size, std::shared_ptr<const void> owner,
+                  std::vector<Segment> segments, int64_t fingerprint = -1) {
+        Record &block = AddRecord();
+        block.segments = std::move(segments);
+        block.fingerprint = fingerprint;
+        Record *block_pointer = &block;
+        CodingOptions options = options_;
+        block.encoded = thread_pool_.Submit([block_pointer, owner, data, size, options] {
+            std::vector<Segment> &segments = block_pointer->segments;
+            Statistics::SetCurrentFile(segments.size() == 1 ? segments.front().member : -1);
+            {
+                StageTimer timer(Stage::CHECKSUM);
+                const unsigned char *segment_data = data;
+                for (Segment &segment : segments) {
+                    segment.checksum = Crc32c(0, segment_data, segment.size);
+                    segment_data += segment.size;
+                }
+            }
+            if (segments.size() > 1 and Statistics::IsEnabled()) {
+                const unsigned char *segment_data = data;
+                for (const Segment &segment : segments) {
+                    SymbolFrequencies frequency{};
+                    CountBytes(segment_data, segment.size, frequency);
+                    Statistics::AddFileFrequency(segment.member, frequency);
+                    segment_data += segment.size;
+                }
+            }
+            thread_local HuffmanCoding huffman_code;
+            huffman_code.SetOptions(options);
+            WriteBlock(block_pointer->bytes, data, size, huffman_code);
+        });
+        WriteRecords(max_pending_records_);
+    }
+    void AddReference(int64_t fingerprint, const unsigned char *data, size_t size, int64_t member) {
+        if (Statistics::IsEnabled()) {
+            SymbolFrequencies frequency{};
+            CountBytes(data, size, frequency);
+            Statistics::AddFileFrequency(member, frequency);
+        }
+        Record &reference = AddRecord();
+        reference.reference = fingerprint;
+        reference.segments.push_back(Segment{member, size});
+        WriteRecords(max_pending_records_);
+    }
+    void AddLink(const std::string &filename, int64_t target) {
+        int64_t member_index = static_cast<int64_t>(members_.size());
+        members_.push_back(MemberInfo{filename});
+        Statistics::AddFile(member_index, filename);
+        Record &link = AddRecord();
+        link.member_header = member_index;
+        link.link_target = target;
+        link.bytes.WriteNext(LINK_TAG);
+        WriteInteger(link.bytes, filename.size(), 2);
+        link.bytes.Write(filename.data(), filename.size());
+        WriteInteger(link.bytes, target, 4);
+        WriteRecords(max_pending_records_);
+    }
+    // Returns the member that already holds the whole of a mapped file, or registers the file as the first copy of
+    // its content for the member it is about to become and returns -1.
+    int64_t FindFileCopy(const std::string &filename, MappedReader &reader, int64_t member) {
+        if (not deduplicate_ or not reader.IsMapped()) {
+            return -1;
+        }
+        const unsigned char *data = nullptr;
+        size_t size = reader.Read(data, reader.Size());
+        reader.Seek(0);
+        uint64_t hash = FastHash(data, size);
+        int64_t copy = FindCopy(file_copies_, hash, data, size);
+        if (copy >= 0) {
+            return file_copies_.fingerprints[copy].member;
+        }
+        AddFingerprint(file_copies_, hash, Fingerprint{filename, 0, size, member});
+        return -1;
+    }
+    // Returns the fingerprint of earlier content equal to data, or -1. A block may repeat an earlier block of its own
+    // member.
+    int64_t FindCopy(CopyTable &table, uint64_t hash, const unsigned char *data, size_t size) {
+        auto [candidate, end] = table.hashes.equal_range(hash);
+        for (; candidate != end; ++candidate) {
+            const Fingerprint &fingerprint = table.fingerprints[candidate->second];
+            if (fingerprint.size == size and MatchesFirstCopy(fingerprint, data)) {
+                return static_cast<int64_t>(candidate->second);
+            }
+        }
+        return -1;
+    }
+    int64_t AddFingerprint(CopyTable &table, uint64_t hash, Fingerprint fingerprint) {
+        table.hashes.emplace(hash, table.fingerprints.size());
+        table.fingerprints.push_back(std::move(fingerprint));
+        return static_cast<int64_t>(table.fingerprints.size() - 1);
+    }
+    // Compares data with the first copy, read again from its file; a first copy that has changed or gone since no
+    // longer matches.
+    bool MatchesFirstCopy(const Fingerprint &fingerprint, const unsigned char *data) {
+        try {
+            MappedReader reader(fingerprint.filename);
+            if (not reader.IsMapped()) {
+                return false;
+            }
+            const unsigned char *first_copy = nullptr;
+            reader.Seek(fingerprint.file_offset);
+            return reader.Read(first_copy, fingerprint.size) == fingerprint.size and
+                   std::equal(data, data + fingerprint.size, first_copy);
+        } catch (FileException &e) {
+            return false;
+        }
+    }
+    void AddSolidGroup(const std::vector<std::string> &filenames, const std::vector<uint64_t> &sizes) {
+        if (filenames.empty()) {
+            return;
+        }
+        int64_t first_member = static_cast<int64_t>(members_.size());
+        Record &header = AddRecord();
+        header.member_header = first_member;
+        header.header_members_count = filenames.size();
+        header.bytes.WriteNext(SOLID_TAG);
+        WriteInteger(header.bytes, filenames.size(), 4);
+        uint64_t position = 0;
+        for (size_t i = 0; i < filenames.size(); ++i) {
+            const std::string &filename = filenames[i];
+            if (filename.size() > UINT16_MAX) {
+                throw ArchiveException("File name is too long: " + filename);
+            }
+            size_t shared_prefix = 0;
+            if (i > 0) {
+                const std::string &previous = filenames[i - 1];
+                size_t length = std::min(previous.size(), filename.size());
+                while (shared_prefix < length and previous[shared_prefix] == filename[shared_prefix]) {
+                    ++shared_prefix;
+                }
+            }
+            WriteVarint(header.bytes, shared_prefix);
+            WriteVarint(header.bytes, filename.size() - shared_prefix);
+            header.bytes.Write(filename.data() + shared_prefix, filename.size() - shared_prefix);
+            WriteVarint(header.bytes, sizes[i]);
+            MemberInfo member{filename};
+            member.position = position;
+            position += sizes[i];
+            Statistics::AddFile(members_.size(), filename);
+            members_.push_back(member);
+        }
+
+        auto block = std::make_shared<std::vector<unsigned char>>();
+        block->reserve(block_size_);
+        std::vector<Segment> segments;
+        for (size_t i = 0; i < filenames.size(); ++i) {
+            int64_t member_index = first_member + static_cast<int64_t>(i);
+            MappedReader reader(filenames[i], pipeline_buffer_size_);
+            const unsigned char *data = nullptr;
+            for (uint64_t left = sizes[i]; left > 0;) {
+                size_t size = reader.Read(data, std::min<uint64_t>(left, block_size_ - block->size()));
+                if (size == 0) {
+                    throw ArchiveException(filenames[i] + " changed while it was archived");
+                }
+                block->insert(block->end(), data, data + size);
+                if (segments.empty() or segments.back().member != member_index) {
+                    segments.push_back(Segment{member_index, 0});
+                }
+                segments.back().size += size;
+                left -= size;
+                if (block->size() == block_size_) {
+                    AddBlock(block->data(), block->size(), block, std::move(segments));
+                    block = std::make_shared<std::vector<unsigned char>>();
+                    block->reserve(block_size_);
+                    segments.clear();
+                }
+            }
+            if (reader.Read(data, 1) != 0) {
+                throw ArchiveException(filenames[i] + " changed while it was archived");
+            }
+        }
+        if (not block->empty()) {
+            AddBlock(block->data(), block->size(), block, std::move(segments));
+        }
+        WriteInteger(AddRecord().bytes, 0, 4);
+        WriteRecords(max_pending_records_);
+    }
+    // Writes finished records in order, waiting for unfinished ones while more than max_pending remain.
+    void WriteRecords(size_t max_pending) {
+        while (not records_.empty()) {
+            Record &record = *records_.front();
+            if (record.encoded.valid()) {
+                if (records_.size() <= max_pending and
+                    record.encoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    return;
+                }
+                record.encoded.get();
+            }
+            if (record.reference >= 0) {
+                const Fingerprint &source = block_copies_.fingerprints[record.reference];
+                record.segments.front().checksum = source.checksum;
+                WriteInteger(record.bytes, record.segments.front().size, 4);
+                WriteInteger(record.bytes, REFERENCE_PAYLOAD_SIZE, 4);
+                WriteInteger(record.bytes, source.offset, 8);
+            }
+            if (record.fingerprint >= 0) {
+                Fingerprint &fingerprint = block_copies_.fingerprints[record.fingerprint];
+                fingerprint.offset = file_writer_.Position();
+                fingerprint.checksum = record.segments.front().checksum;
+            }
+            if (record.link_target >= 0) {
+                members_[record.member_header].original_size = members_[record.link_target].original_size;
+                members_[record.member_header].checksum = members_[record.link_target].checksum;
+            }
+            for (size_t i = 0; record.member_header >= 0 and i < record.header_members_count; ++i) {
+                members_[record.member_header + i].offset = file_writer_.Position();
+            }
+            size_t raw_size = 0;
+            for (const Segment &segment : record.segments) {
+                raw_size += segment.size;
+            }
+            for (const Segment &segment : record.segments) {
+                MemberInfo &member = members_[segment.member];
+                member.checksum = Crc32cCombine(member.checksum, segment.checksum, segment.size);
+                member.original_size += segment.size;
+                Statistics::AddFileSizes(segment.member, segment.size, record.bytes.Size() * segment.size / raw_size);
+            }
+            file_writer_.Write(record.bytes.Data(), record.bytes.Size());
+            records_.pop_front();
+        }
+    }
+
+    FileWriter file_writer_;
+    size_t block_size_;
+    size_t pipeline_buffer_size_;
+    CodingOptions options_;
+    size_t max_pending_records_;
+    bool deduplicate_ = false;
+    CopyTable file_copies_;
+    CopyTable block_copies_;
+    std::vector<MemberInfo> members_;
+    std::string filename_;
+    uint64_t records_end_ = 0;
+    std::vector<char> old_tail_;
+    bool is_closed_ = false;
+    std::deque<std::unique_ptr<Record>> records_;
+    ThreadPool thread_pool_;
+};
+
+// A mapped archive is restored through its index: every member gets a preallocated output file and its blocks are
+// decoded on the thread pool straight into their own regions of it. A streamed archive is restored in order, with a
+// reader thread reading ahead of the decoder and large members written by writer threads of their own.
+class ArchiveReader {
+public:
+    explicit ArchiveReader(std::string filename, size_t threads_count = 1, const Dictionary *dictionary = nullptr,
+                           size_t pipeline_buffer_size = DEFAULT_PIPELINE_BUFFER_SIZE)
+        : reader_(filename, pipeline_buffer_size),
+          dictionary_(dictionary),
+          pipeline_buffer_size_(pipeline_buffer_size),
+          max_pending_blocks_(2 * threads_count + 1),
+          thread_pool_(threads_count > 1 ? threads_count : 0) {
+        const unsigned char *magic = ReadExactly(ARCHIVE_MAGIC_SIZE + 1);
+        if (not std::equal(ARCHIVE_MAGIC, ARCHIVE_MAGIC + ARCHIVE_MAGIC_SIZE, magic)) {
+            throw ArchiveException(filename + " is not an archive");
+        }
+        if (magic[ARCHIVE_MAGIC_SIZE] != ARCHIVE_VERSION) {
+            throw ArchiveException("Unsupported archive version " + std::to_string(magic[ARCHIVE_MAGIC_SIZE]));
+        }
+        dictionary_id_ = static_cast<uint32_t>(ReadInteger(4));
+        huffman_code_.SetDictionary(dictionary_);
+    }
+    void ExtractAll() {
+        CheckDictionary();
+        if (reader_.IsMapped()) {
+            std::vector<MemberInfo> index = ReadIndex();
+            std::vector<size_t> wanted(index.size());
+            std::iota(wanted.begin(), wanted.end(), 0);
+            ExtractMembers(index, wanted);
+            return;
+        }
+        RecordHeader header;
+        while (char tag = ReadRecordHeader(header)) {
+            if (tag == SOLID_TAG) {
+                DecodeSolid(header, std::vector<bool>(header.files.size(), true));
+            } else if (tag == LINK_TAG) {
+                RestoreLink(header);
+            } else {
+                RestoreMember(header);
+            }
+        }
+        CheckRestoredMembers();
+    }
+    // Extracts only the named members. A mapped archive is entered through the index and only the requested
+    // members are read; a streamed one is scanned from the start.
+    void Extract(const std::vector<std::string> &names) {
+        CheckDictionary();
+        std::set<std::string> missing(names.begin(), names.end());
+        if (reader_.IsMapped()) {
+            std::vector<MemberInfo> index = ReadIndex();
+            std::vector<size_t> wanted;
+            for (size_t i = 0; i < index.size(); ++i) {
+                if (std::find(names.begin(), names.end(), index[i].name) != names.end()) {
+                    wanted.push_back(i);
+                    missing.erase(index[i].name);
+                }
+            }
+            ExtractMembers(index, wanted);
+        } else {
+            RecordHeader header;
+            while (char tag = ReadRecordHeader(header)) {
+                if (tag == SOLID_TAG) {
+                    std::vector<bool> wanted;
+                    for (const MemberInfo &file : header.files) {
+                        wanted.push_back(std::find(names.begin(), names.end(), file.name) != names.end());
+                        missing.erase(file.name);
+                    }
+                    DecodeSolid(header, wanted);
+                } else if (std::find(names.begin(), names.end(), header.name) == names.end()) {
+                    if (tag == MEMBER_TAG) {
+                        DecodeMember(nullptr, header.first_member);
+                    }
+                } else {
+                    if (tag == LINK_TAG) {
+                        RestoreLink(header);
+                    } else {
+                        RestoreMember(header);
+                    }
+                    missing.erase(header.name);
+                }
+            }
+            CheckRestoredMembers();
+        }
+        if (not missing.empty()) {
+            throw ArchiveException("No member named " + *missing.begin());
+        }
+    }
+    // Decodes every member and compares its data with the CRC-32C in the index, writing no file, and returns the
+    // names of the members that do not match. Damage to the structure of the archive still throws.
+    std::vector<std::string> Test() {
+        testing_ = true;
+        damaged_.clear();
+        ExtractAll();
+        testing_ = false;
+        return damaged_;
+    }
+    std::vector<MemberInfo> ReadIndex() {
+        if (reader_.IsMapped()) {
+            if (reader_.Size() < ARCHIVE_HEADER_SIZE + TRAILER_SIZE) {
+                throw ArchiveException("Archive has no index");
+            }
+            reader_.Seek(reader_.Size() - TRAILER_SIZE);
+            uint64_t index_offset = ReadInteger(8);
+            const unsigned char *magic = ReadExactly(ARCHIVE_MAGIC_SIZE);
+            if (not std::equal(INDEX_MAGIC, INDEX_MAGIC + ARCHIVE_MAGIC_SIZE, magic) or
+                index_offset > reader_.Size() - TRAILER_SIZE) {
+                throw ArchiveException("Archive has no index");
+            }
+            reader_.Seek(index_offset);
+            index_offset_ = index_offset;
+        } else {
+            RecordHeader header;
+            while (char tag = ReadRecordHeader(header)) {
+                if (tag == SOLID_TAG) {
+                    DecodeSolid(header, std::vector<bool>(header.files.size(), false));
+                } else if (tag == MEMBER_TAG) {
+                    DecodeMember(nullptr, header.first_member);
+                }
+            }
+        }
+        return ReadIndexEntries();
+    }
+    // Offset of the end marker of a mapped archive whose index has been read, where appended records start.
+    uint64_t RecordsEnd() {
+        if (not reader_.IsMapped()) {
+            throw ArchiveException("Only an archive file can be appended to");
+        }
+        if (index_offset_ <= ARCHIVE_HEADER_SIZE) {
+            throw ArchiveException("Corrupted archive: bad index offset");
+        }
+        reader_.Seek(index_offset_ - 1);
+        if (ReadInteger(1) != static_cast<uint64_t>(ARCHIVE_END_TAG)) {
+            throw ArchiveException("Corrupted archive: no end marker before the index");
+        }
+        return index_offset_ - 1;
+    }
+    uint32_t DictionaryId() const {
+        return dictionary_id_;
+    }
+
+private:
+    // Header of a record: the name of a member or a link, the target of a link or the files of a solid group, and
+    // the index of the first member in the record when the archive is read from the start.
+    struct RecordHeader {
+        std::string name;
+        std::vector<MemberInfo> files;
+        uint32_t link_target = 0;
+        size_t first_member = 0;
+    };
+    // A member restored from the data of source, which is the member itself or the target of its link, and the
+    // checksum the index gives for it.
+    struct Restore {
+        MemberInfo source;
+        std::string name;
+        uint32_t checksum = 0;
+    };
+    // A block of a streamed archive that has been decoded: the member and position it was restored to, its size and
+    // its checksum.
+    struct RestoredBlock {
+        size_t member = 0;
+        uint64_t position = 0;
+        size_t size = 0;
+        uint32_t checksum = 0;
+    };
+
+    void CheckDictionary() const {
+        if (dictionary_id_ == 0 or (dictionary_ != nullptr and dictionary_->GetId() == dictionary_id_)) {
+            return;
+        }
+        std::ostringstream id;
+        id << std::hex << std::setw(8) << std::setfill('0') << dictionary_id_;
+        if (dictionary_ == nullptr) {
+            throw ArchiveException("Archive needs dictionary " + id.str() + ", pass it with -D");
+        }
+        throw ArchiveException("Archive needs dictionary " + id.str() + ", not the given one");
+    }
+    // Reads the index, which starts at the current position.
+    std::vector<MemberInfo> ReadIndexEntries() {
+        std::vector<MemberInfo> members(ReadInteger(4));
+        for (MemberInfo &member : members) {
+            size_t name_length = ReadInteger(2);
+            const unsigned char *name = ReadExactly(name_length);
+            member.name.assign(name, name + name_length);
+            member.original_size = ReadInteger(8);
+            member.offset = ReadInteger(8);
+            member.position = ReadInteger(8);
+            member.checksum = static_cast<uint32_t>(ReadInteger(4));
+        }
+        return members;
+    }
+    // Compares the members restored from a streamed archive with the index that follows the records.
+    void CheckRestoredMembers() {
+        std::vector<MemberInfo> index = ReadIndexEntries();
+        for (const auto &[member, checksum] : checksums_) {
+            if (member >= index.size()) {
+                throw ArchiveException("Corrupted archive: index does not match the records");
+            }
+            CheckMember(index[member].name, checksum, index[member].checksum);
+        }
+    }
+    void CheckMember(const std::string &name, uint32_t checksum, uint32_t expected) {
+        if (checksum == expected) {
+            return;
+        }
+        if (not testing_) {
+            throw ArchiveException("Checksum mismatch in " + name);
+        }
+        damaged_.push_back(name);
+    }
+    static uint32_t UpdateChecksum(uint32_t checksum, const unsigned char *data, size_t size) {
+        StageTimer timer(Stage::CHECKSUM);
+        return Crc32c(checksum, data, size);
+    }
+    // Restores the wanted members of the index, the last one of every name only. A link is restored from the data
+    // of its target, and a block that repeats an earlier one is decoded again from the earlier block.
+    // Every block is checksummed by the task that decodes it, and the checksums are merged in order as the blocks
+    // finish; the entry queued after the last block of a member compares the result with the index.
+    void ExtractMembers(const std::vector<MemberInfo> &index, const std::vector<size_t> &wanted) {
+        std::set<std::string> restored;
+        std::map<uint64_t, std::vector<Restore>> solid_groups;
+        struct PendingBlock {
+            std::future<void> decoded;
+            std::shared_ptr<uint32_t> checksum;
+            uint64_t size = 0;
+            const MemberInfo *member = nullptr;
+        };
+        std::deque<PendingBlock> pending_blocks;
+        uint32_t checksum = 0;
+        auto finish_block = [this, &pending_blocks, &checksum] {
+            PendingBlock &block = pending_blocks.front();
+            if (block.member == nullptr) {
+                block.decoded.get();
+                checksum = Crc32cCombine(checksum, *block.checksum, block.size);
+            } else {
+                CheckMember(block.member->name, checksum, block.member->checksum);
+                checksum = 0;
+            }
+            pending_blocks.pop_front();
+        };
+        for (auto entry = wanted.rbegin(); entry != wanted.rend(); ++entry) {
+            const MemberInfo &member = index[*entry];
+            if (not restored.insert(member.name).second and not testing_) {
+                continue;
+            }
+            Restore restore{member, member.name, member.checksum};
+            RecordHeader header;
+            char tag = 0;
+            if (solid_groups.count(member.offset) == 0) {
+                reader_.Seek(member.offset);
+                tag = ReadRecordHeader(header);
+                if (tag == LINK_TAG) {
+                    if (header.name != member.name or header.link_target >= index.size() or
+                        index[header.link_target].original_size != member.original_size) {
+                        throw ArchiveException("Corrupted archive: index does not match member " + member.name);
+                    }
+                    restore.source = index[header.link_target];
+                    tag = 0;
+                }
+            }
+            if (solid_groups.count(restore.source.offset) > 0) {
+                solid_groups[restore.source.offset].push_back(restore);
+                continue;
+            }
+            if (tag == 0) {
+                reader_.Seek(restore.source.offset);
+                tag = ReadRecordHeader(header);
+            }
+            if (tag == SOLID_TAG) {
+                solid_groups[restore.source.offset].push_back(restore);
+                continue;
+            }
+            if (tag != MEMBER_TAG or header.name != restore.source.name) {
+                throw ArchiveException("Corrupted archive: index does not match member " + member.name);
+            }
+            if (restore.name == "-" and not testing_) {
+                FileWriter file_writer(restore.name, pipeline_buffer_size_);
+                uint32_t member_checksum = DecodeMember(&file_writer, 0);
+                file_writer.Close();
+                CheckMember(member.name, member_checksum, member.checksum);
+                continue;
+            }
+            std::shared_ptr<OutputFile> output_file;
+            if (not testing_) {
+                output_file = std::make_shared<OutputFile>(restore.name, member.original_size);
+            }
+            uint64_t position = 0;
+            while (size_t size = ReadInteger(4)) {
+                size_t payload_size = ReadInteger(4);
+                const unsigned char *payload = ReadPayload(size, payload_size);
+                if (position + size > member.original_size) {
+                    throw ArchiveException("Corrupted archive: block is too large");
+                }
+                auto block_checksum = std::make_shared<uint32_t>(0);
+                const Dictionary *dictionary = dictionary_;
+                std::future<void> decoded = thread_pool_.Submit([output_file, block_checksum, payload, payload_size,
+                                                                 size, position, dictionary] {
+                    thread_local HuffmanCoding huffman_code;
+                    huffman_code.SetDictionary(dictionary);
+                    if (output_file != nullptr and output_file->Data() != nullptr) {
+                        unsigned char *output = output_file->Data() + position;
+                        huffman_code.DecodeBlock(payload, payload_size, output, size);
+                        Statistics::Add(Counter::BYTES_WRITTEN, size);
+                        *block_checksum = UpdateChecksum(0, output, size);
+                        return;
+                    }
+                    thread_local std::vector<unsigned char> output;
+                    output.resize(size);
+                    huffman_code.DecodeBlock(payload, payload_size, output.data(), size);
+                    *block_checksum = UpdateChecksum(0, output.data(), size);
+                    if (output_file != nullptr) {
+                        output_file->WriteAt(reinterpret_cast<const char *>(output.data()), size, position);
+                    }
+                });
+                pending_blocks.push_back(PendingBlock{std::move(decoded), block_checksum, size});
+                position += size;
+                while (pending_blocks.size() > max_pending_blocks_) {
+                    finish_block();
+                }
+            }
+            if (position != member.original_size) {
+                throw ArchiveException("Corrupted archive: size of " + member.name + " does not match the index");
+            }
+            pending_blocks.push_back(PendingBlock{{}, nullptr, 0, &member});
+        }
+        while (not pending_blocks.empty()) {
+            finish_block();
+        }
+        for (auto &[offset, group_members] : solid_groups) {
+            ExtractSolid(offset, group_members);
+        }
+    }
+    // Decodes only the blocks of a solid group that hold some of the given members, on the thread pool, and writes
+    // their parts in order as the blocks finish, so only one file of the group is open at a time.
+    // A file and its links cover the same range of the stream, so their parts are written side by side.
+    void ExtractSolid(uint64_t offset, std::vector<Restore> &members) {
+        RecordHeader header;
+        reader_.Seek(offset);
+        ReadRecordHeader(header);
+        const std::vector<MemberInfo> &files = header.files;
+        for (const Restore &restore : members) {
+            const MemberInfo &member = restore.source;
+            auto file = std::lower_bound(files.begin(), files.end(), member.position,
+                                         [](const MemberInfo &file, uint64_t position) {
+                                             return file.position < position;
+                                         });
+            while (file != files.end() and file->position == member.position and file->name != member.name) {
+                ++file;
+            }
+            if (file == files.end() or file->position != member.position or
+                file->original_size != member.original_size) {
+                throw ArchiveException("Corrupted archive: index does not match member " + restore.name);
+            }
+        }
+        std::sort(members.begin(), members.end(), [](const Restore &first, const Restore &second) {
+            return first.source.position < second.source.position;
+        });
+        uint64_t end = 0;
+        for (const Restore &restore : members) {
+            if (restore.source.original_size == 0) {
+                if (not testing_) {
+                    OutputFile(restore.name, 0);
+                }
+                CheckMember(restore.name, 0, restore.checksum);
+            }
+            end = std::max(end, restore.source.position + restore.source.original_size);
+        }
+
+        struct Part {
+            size_t member;
+            size_t begin;
+            size_t size;
+            uint64_t position;
+            bool is_last;
+        };
+        struct DecodedBlock {
+            std::future<void> decoded;
+            std::shared_ptr<std::vector<unsigned char>> output;
+            std::shared_ptr<std::vector<uint32_t>> checksums;
+            std::vector<Part> parts;
+        };
+        std::deque<DecodedBlock> decoded_blocks;
+        std::map<size_t, std::unique_ptr<OutputFile>> output_files;
+        std::map<size_t, uint32_t> checksums;
+        auto write_block = [this, &members, &decoded_blocks, &output_files, &checksums] {
+            DecodedBlock &block = decoded_blocks.front();
+            block.decoded.get();
+            for (size_t i = 0; i < block.parts.size(); ++i) {
+                const Part &part = block.parts[i];
+                const Restore &restore = members[part.member];
+                uint32_t &checksum = checksums[part.member];
+                checksum = part.position == 0 ? (*block.checksums)[i]
+                                              : Crc32cCombine(checksum, (*block.checksums)[i], part.size);
+                if (not testing_) {
+                    std::unique_ptr<OutputFile> &output_file = output_files[part.member];
+                    if (part.position == 0) {
+                        output_file = std::make_unique<OutputFile>(restore.name, restore.source.original_size);
+                    }
+                    const char *data = reinterpret_cast<const char *>(block.output->data()) + part.begin;
+                    output_file->WriteAt(data, part.size, part.position);
+                }
+                if (part.is_last) {
+                    output_files.erase(part.member);
+                    CheckMember(restore.name, checksum, restore.checksum);
+                    checksums.erase(part.member);
+                }
+            }
+            decoded_blocks.pop_front();
+        };
+        size_t first = 0;
+        for (uint64_t position = 0; position < end;) {
+            size_t size = ReadInteger(4);
+            if (size == 0) {
+                throw ArchiveException("Corrupted archive: solid group is shorter than its files");
+            }
+            size_t payload_size = ReadInteger(4);
+            CheckBlockSizes(size, payload_size);
+            const unsigned char *payload = ReadExactly(payload_size);
+            while (first < members.size() and
+                   members[first].source.position + members[first].source.original_size <= position) {
+                ++first;
+            }
+            DecodedBlock block;
+            for (size_t i = first; i < members.size() and members[i].source.position < position + size; ++i) {
+                const MemberInfo &member = members[i].source;
+                uint64_t member_end = member.position + member.original_size;
+                uint64_t begin = std::max(member.position, position);
+                uint64_t finish = std::min(member_end, position + size);
+                if (begin < finish) {
+                    block.parts.push_back(
+                        Part{i, begin - position, finish - begin, begin - member.position, finish == member_end});
+                }
+            }
+            position += size;
+            if (block.parts.empty()) {
+                continue;
+            }
+            block.output = std::make_shared<std::vector<unsigned char>>(size);
+            block.checksums = std::make_shared<std::vector<uint32_t>>(block.parts.size());
+            auto output = block.output;
+            auto part_checksums = block.checksums;
+            std::vector<std::pair<size_t, size_t>> part_ranges;
+            for (const Part &part : block.parts) {
+                part_ranges.emplace_back(part.begin, part.size);
+            }
+            const Dictionary *dictionary = dictionary_;
+            block.decoded = thread_pool_.Submit([output, part_checksums, part_ranges, payload, payload_size,
+                                                 dictionary] {
+                thread_local HuffmanCoding huffman_code;
+                huffman_code.SetDictionary(dictionary);
+                huffman_code.DecodeBlock(payload, payload_size, output->data(), output->size());
+                for (size_t i = 0; i < part_ranges.size(); ++i) {
+                    const auto &[begin, size] = part_ranges[i];
+                    (*part_checksums)[i] = UpdateChecksum(0, output->data() + begin, size);
+                }
+            });
+            decoded_blocks.push_back(std::move(block));
+            while (decoded_blocks.size() > max_pending_blocks_) {
+                write_block();
+            }
+        }
+        while (not decoded_blocks.empty()) {
+            write_block();
+        }
+    }
+    // Reads the next record up to its first block and returns its tag, or 0 at the end of the records. A member
+    // record or a link sets the name; a solid group fills files with the names, sizes and positions of its files.
+    char ReadRecordHeader(RecordHeader &header) {
+        header.first_member = next_member_;
+        char tag = static_cast<char>(ReadInteger(1));
+        if (tag == ARCHIVE_END_TAG) {
+            return 0;
+        }
+        std::string &name = header.name;
+        if (tag == MEMBER_TAG or tag == LINK_TAG) {
+            size_t name_length = ReadInteger(2);
+            const unsigned char *data = ReadExactly(name_length);
+            name.assign(data, data + name_length);
+            if (tag == LINK_TAG) {
+                header.link_target = static_cast<uint32_t>(ReadInteger(4));
+            }
+            ++next_member_;
+            return tag;
+        }
+        if (tag != SOLID_TAG) {
+            throw ArchiveException("Corrupted archive: unknown record");
+        }
+        std::vector<MemberInfo> &files = header.files;
+        files.clear();
+        uint64_t position = 0;
+        for (size_t files_count = ReadInteger(4); files.size() < files_count;) {
+            uint64_t shared_prefix = ReadVarint();
+            uint64_t suffix_length = ReadVarint();
+            if (shared_prefix > name.size() or suffix_length > UINT16_MAX - shared_prefix or
+                (files.empty() and shared_prefix > 0)) {
+                throw ArchiveException("Corrupted archive: bad file name in solid group");
+            }
+            const unsigned char *suffix = ReadExactly(suffix_length);
+            name.resize(shared_prefix);
+            name.append(suffix, suffix + suffix_length);
+            MemberInfo file{name};
+            file.original_size = ReadVarint();
+            file.position = position;
+            if (file.original_size > UINT64_MAX - position) {
+                throw ArchiveException("Corrupted archive: bad file size in solid group");
+            }
+            position += file.original_size;
+            files.push_back(file);
+        }
+        next_member_ += files.size();
+        return tag;
+    }
+    // Decodes a solid group in order, writing the wanted files and skipping the blocks when none is wanted. The
+    // checksum of every wanted file is kept for the index at the end.
+    void DecodeSolid(const RecordHeader &header, const std::vector<bool> &wanted) {
+        const std::vector<MemberInfo> &files = header.files;
+        bool decode = std::find(wanted.begin(), wanted.end(), true) != wanted.end();
+        std::unique_ptr<FileWriter> file_writer;
+        size_t next = 0;
+        uint64_t left = 0;
+        uint32_t checksum = 0;
+        auto finish_file = [this, &header, &wanted, &file_writer, &next, &checksum] {
+            if (next == 0 or not wanted[next - 1]) {
+                return;
+            }
+            if (file_writer != nullptr) {
+                file_writer->Close();
+                file_writer.reset();
+                MarkRestored(header.first_member + next - 1, header.files[next - 1].name);
+            }
+            checksums_[header.first_member + next - 1] = checksum;
+        };
+        while (size_t size = ReadInteger(4)) {
+            size_t payload_size = ReadInteger(4);
+            CheckBlockSizes(size, payload_size);
+            const unsigned char *payload = ReadExactly(payload_size);
+            if (decode) {
+                output_.resize(size);
+                huffman_code_.DecodeBlock(payload, payload_size, output_.data(), size);
+            }
+            for (size_t done = 0; done < size;) {
+                // Moves on to the next file with data left, creating the empty files on the way.
+                while (left == 0) {
+                    if (next == files.size()) {
+                        throw ArchiveException("Corrupted archive: solid group is longer than its files");
+                    }
+                    finish_file();
+                    if (wanted[next] and not testing_) {
+                        restored_members_.erase(files[next].name);
+                        file_writer = std::make_unique<FileWriter>(files[next].name, pipeline_buffer_size_);
+                    }
+                    checksum = 0;
+                    left = files[next++].original_size;
+                }
+                size_t count = std::min<uint64_t>(left, size - done);
+                if (wanted[next - 1]) {
+                    checksum = UpdateChecksum(checksum, output_.data() + done, count);
+                }
+                if (file_writer != nullptr) {
+                    file_writer->Write(reinterpret_cast<const char *>(output_.data()) + done, count);
+                }
+                done += count;
+                left -= count;
+            }
+        }
+        if (left > 0) {
+            throw ArchiveException("Corrupted archive: solid group is shorter than its files");
+        }
+        finish_file();
+        for (; next < files.size(); ++next) {
+            if (files[next].original_size > 0) {
+                throw ArchiveException("Corrupted archive: solid group is shorter than its files");
+            }
+            if (wanted[next]) {
+                if (not testing_) {
+                    FileWriter(files[next].name).Close();
+                    MarkRestored(header.first_member + next, files[next].name);
+                }
+                checksums_[header.first_member + next] = 0;
+            }
+        }
+    }
+    void RestoreMember(const RecordHeader &header) {
+        if (testing_) {
+            checksums_[header.first_member] = DecodeMember(nullptr, header.first_member);
+            return;
+        }
+        restored_members_.erase(header.name);
+        FileWriter file_writer(header.name, pipeline_buffer_size_);
+        // Marked up front, since a block may repeat an earlier block of the same member.
+        MarkRestored(header.first_member, header.name);
+        checksums_[header.first_member] = DecodeMember(&file_writer, header.first_member);
+        file_writer.Close();
+    }
+    // Restores a link of a streamed archive by copying the file its target has been restored to. A tested link takes
+    // the checksum of its target.
+    void RestoreLink(const RecordHeader &header) {
+        auto target_checksum = checksums_.find(header.link_target);
+        if (header.link_target >= header.first_member or (testing_ and target_checksum == checksums_.end())) {
+            throw ArchiveException("Corrupted archive: bad link " + header.name);
+        }
+        if (testing_) {
+            checksums_[header.first_member] = target_checksum->second;
+            return;
+        }
+        std::string target = RestoredFile(header.link_target);
+        uint32_t checksum = checksums_[header.link_target];
+        if (target != header.name) {
+            MappedReader source(target);
+            restored_members_.erase(header.name);
+            FileWriter file_writer(header.name, pipeline_buffer_size_);
+            const unsigned char *data = nullptr;
+            checksum = 0;
+            while (size_t size = source.Read(data, DEFAULT_BLOCK_SIZE)) {
+                checksum = UpdateChecksum(checksum, data, size);
+                file_writer.Write(reinterpret_cast<const char *>(data), size);
+            }
+            file_writer.Close();
+        }
+        checksums_[header.first_member] = checksum;
+        MarkRestored(header.first_member, header.name);
+    }
+    // Decodes the blocks of the current member into file_writer and returns the checksum of its data. With a null
+    // file_writer the blocks are only checksummed when testing and skipped otherwise. A block that repeats an earlier
+    // one is decoded from that block again in a mapped archive and copied from the file it has been restored to in a
+    // streamed one.
+    uint32_t DecodeMember(FileWriter *file_writer, size_t member) {
+        bool decode = file_writer != nullptr or testing_;
+        uint32_t checksum = 0;
+        for (uint64_t position = 0;;) {
+            uint64_t offset = reader_.Position();
+            size_t size = ReadInteger(4);
+            if (size == 0) {
+                return checksum;
+            }
+            size_t payload_size = ReadInteger(4);
+            uint32_t block_checksum = 0;
+            if (payload_size == REFERENCE_PAYLOAD_SIZE and not reader_.IsMapped()) {
+                uint64_t source_offset = ReadInteger(8);
+                if (decode) {
+                    block_checksum = CopyRestoredBlock(source_offset, size, file_writer, member);
+                }
+            } else {
+                const unsigned char *payload = ReadPayload(size, payload_size);
+                if (decode) {
+                    output_.resize(size);
+                    huffman_code_.DecodeBlock(payload, payload_size, output_.data(), size);
+                    block_checksum = UpdateChecksum(0, output_.data(), size);
+                    if (file_writer != nullptr) {
+                        file_writer->Write(reinterpret_cast<const char *>(output_.data()), size);
+                    }
+                }
+            }
+            if (decode) {
+                checksum = Crc32cCombine(checksum, block_checksum, size);
+                if (not reader_.IsMapped()) {
+                    restored_blocks_[offset] = RestoredBlock{member, position, size, block_checksum};
+                }
+            }
+            position += size;
+        }
+    }
+    // Reads the payload of a block, or of the earlier block that a reference in a mapped archive points to.
+    const unsigned char *ReadPayload(size_t size, size_t &payload_size) {
+        if (payload_size != REFERENCE_PAYLOAD_SIZE) {
+            CheckBlockSizes(size, payload_size);
+            return ReadExactly(payload_size);
+        }
+        uint64_t source_offset = ReadInteger(8);
+        size_t position = reader_.Position();
+        if (source_offset >= position) {
+            throw ArchiveException("Corrupted archive: bad block reference");
+        }
+        reader_.Seek(source_offset);
+        size_t source_size = ReadInteger(4);
+        payload_size = ReadInteger(4);
+        if (source_size != size or payload_size == REFERENCE_PAYLOAD_SIZE) {
+            throw ArchiveException("Corrupted archive: bad block reference");
+        }
+        CheckBlockSizes(size, payload_size);
+        const unsigned char *payload = ReadExactly(payload_size);
+        reader_.Seek(position);
+        return payload;
+    }
+    // Copies a block of a streamed archive that repeats an earlier one from the file the earlier one has been restored
+    // to, and returns its checksum. Without file_writer it only returns the checksum the earlier block had. When the
+    // earlier block belongs to the member being restored, its file is read back after file_writer is drained.
+    uint32_t CopyRestoredBlock(uint64_t source_offset, size_t size, FileWriter *file_writer, size_t member) {
+        auto block = restored_blocks_.find(source_offset);
+        if (block == restored_blocks_.end()) {
+            throw ArchiveException("A block repeats data that was not restored from this stream, "
+                                   "extract from the archive file instead");
+        }
+        if (block->second.size != size) {
+            throw ArchiveException("Corrupted archive: bad block reference");
+        }
+        if (file_writer == nullptr) {
+            return block->second.checksum;
+        }
+        std::string source_name = RestoredFile(block->second.member);
+        if (block->second.member == member) {
+            file_writer->Drain();
+        }
+        MappedReader source(source_name);
+        const unsigned char *data = nullptr;
+        if (not source.IsMapped() or source.Size() < block->second.position + size) {
+            throw ArchiveException(source_name + " changed while the archive was extracted");
+        }
+        source.Seek(block->second.position);
+        size_t count = source.Read(data, size);
+        file_writer->Write(reinterpret_cast<const char *>(data), count);
+        return UpdateChecksum(0, data, count);
+    }
+    void MarkRestored(size_t member, const std::string &name) {
+        if (name == "-") {
+            return;
+        }
+        if (restored_files_.size() <= member) {
+            restored_files_.resize(member + 1);
+        }
+        restored_files_[member] = name;
+        restored_members_[name] = member;
+    }
+    // Returns the file a member of a streamed archive has been restored to, if it still holds that member.
+    std::string RestoredFile(size_t member) {
+        auto restored = member < restored_files_.size() ? restored_members_.find(restored_files_[member])
+                                                         : restored_members_.end();
+        if (restored == restored_members_.end() or restored->second != member) {
+            throw ArchiveException("A member repeats data that was not restored from this stream, "
+                                   "extract from the archive file instead");
+        }
+        return restored_files_[member];
+    }
+    const unsigned char *ReadExactly(size_t size) {
+        const unsigned char *data = nullptr;
+        if (reader_.Read(data, size) != size) {
+            throw ArchiveException("Unexpected end of archive");
+        }
+        return data;
+    }
+    uint64_t ReadInteger(int32_t bytes_count) {
+        return LoadInteger(ReadExactly(bytes_count), bytes_count);
+    }
+    uint64_t ReadVarint() {
+        uint64_t value = 0;
+        for (int32_t shift = 0; shift < 64; shift += 7) {
+            uint64_t byte = ReadInteger(1);
+            value |= (byte & 0x7F) << shift;
+            if (byte < 0x80) {
+                return value;
+            }
+        }
+        throw ArchiveException("Corrupted archive: bad varint");
+    }
+
+    MappedReader reader_;
+    const Dictionary *dictionary_;
+    size_t pipeline_buffer_size_;
+    uint32_t dictionary_id_ = 0;
+    uint64_t index_offset_ = 0;
+    HuffmanCoding huffman_code_;
+    std::vector<unsigned char> output_;
+    size_t max_pending_blocks_;
+    size_t next_member_ = 0;
+    std::vector<std::string> restored_files_;
+    std::map<std::string, size_t> restored_members_;
+    std::unordered_map<uint64_t, RestoredBlock> restored_blocks_;
+    std::map<size_t, uint32_t> checksums_;
+    bool testing_ = false;
+    std::vector<std::string> damaged_;
+    ThreadPool thread_pool_;
+};
@@ -1,14 +1,211 @@
+#include <iomanip>
+#include <memory>
+
 #include "arg_parser.h"
-#include "huffman_coding.h"
+#include "archive.h"
+
+const int32_t MAX_THREADS_COUNT = 1024;
+
+int16_t ParseMaxCodeLength(ArgParser& arg_parser) {
+    if (not arg_parser.HasField("-m")) {
+        return MAX_CODE_LENGTH;
+    }
+    int32_t max_code_length = 0;
+    try {
+        max_code_length = std::stoi(arg_parser.GetArgument("-m", 0));
+    } catch (std::exception& e) {
+        throw ArgumentException("-m expects a number of bits");
+    }
+    if (max_code_length < ARCHIVED_BYTE or max_code_length > MAX_CODE_LENGTH) {
+        throw ArgumentException("-m must be between " + std::to_string(ARCHIVED_BYTE) + " and " +
+                                std::to_string(MAX_CODE_LENGTH));
+    }
+    return static_cast<int16_t>(max_code_length);
+}
+
+// Parses a size in bytes with an optional K or M suffix.
+size_t ParseSize(const std::string& argument, const std::string& error) {
+    size_t size = 0;
+    size_t position = 0;
+    try {
+        size = std::stoull(argument, &position);
+    } catch (std::exception& e) {
+        throw ArgumentException(error);
+    }
+    std::string suffix = argument.substr(position);
+    if (suffix == "K" or suffix == "k") {
+        size <<= 10;
+    } else if (suffix == "M" or suffix == "m") {
+        size <<= 20;
+    } else if (not suffix.empty()) {
+        throw ArgumentException(error);
+    }
+    return size;
+}
+
+size_t ParseBlockSize(ArgParser& arg_parser) {
+    if (not arg_parser.HasField("-b")) {
+        return DEFAULT_BLOCK_SIZE;
+    }
+    size_t block_size = ParseSize(arg_parser.GetArgument("-b", 0), "-b expects a block size");
+    if (block_size < MIN_BLOCK_SIZE or block_size > MAX_BLOCK_SIZE) {
+        throw ArgumentException("-b must be between " + std::to_string(MIN_BLOCK_SIZE >> 10) + "K and " +
+                                std::to_string(MAX_BLOCK_SIZE >> 20) + "M");
+    }
+    return block_size;
+}
+
+size_t ParsePipelineBufferSize(ArgParser& arg_parser) {
+    if (not arg_parser.HasField("-B")) {
+        return DEFAULT_PIPELINE_BUFFER_SIZE;
+    }
+    size_t buffer_size = ParseSize(arg_parser.GetArgument("-B", 0), "-B expects a buffer size");
+    if (buffer_size != 0 and (buffer_size < MIN_PIPELINE_BUFFER_SIZE or buffer_size > MAX_PIPELINE_BUFFER_SIZE)) {
+        throw ArgumentException("-B must be 0 or between " + std::to_string(MIN_PIPELINE_BUFFER_SIZE >> 10) +
+                                "K and " + std::to_string(MAX_PIPELINE_BUFFER_SIZE >> 20) + "M");
+    }
+    return buffer_size;
+}
+
+size_t ParseThreadsCount(ArgParser& arg_parser) {
+    if (not arg_parser.HasField("-j")) {
+        return 1;
+    }
+    int32_t threads_count = 0;
+    try {
+        threads_count = std::stoi(arg_parser.GetArgument("-j", 0));
+    } catch (std::exception& e) {
+        throw ArgumentException("-j expects a number of threads");
+    }
+    if (threads_count < 0 or threads_count > MAX_THREADS_COUNT) {
+        throw ArgumentException("-j must be between 0 and " + std::to_string(MAX_THREADS_COUNT));
+    }
+    if (threads_count == 0) {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+    return threads_count;
+}
+
+int32_t ParseStreamsCount(ArgParser& arg_parser) {
+    if (not arg_parser.HasField("-s")) {
+        return 1;
+    }
+    int32_t streams_count = 0;
+    try {
+        streams_count = std::stoi(arg_parser.GetArgument("-s", 0));
+    } catch (std::exception& e) {
+        throw ArgumentException("-s expects a number of streams");
+    }
+    if (streams_count != 1 and streams_count != 4 and streams_count != MAX_STREAMS_COUNT) {
+        throw ArgumentException("-s must be 1, 4 or " + std::to_string(MAX_STREAMS_COUNT));
+    }
+    return streams_count;
+}
+
+int32_t ParseLzLevel(ArgParser& arg_parser) {
+    if (not arg_parser.HasField("-L")) {
+        return 0;
+    }
+    int32_t lz_level = 0;
+    try {
+        lz_level = std::stoi(arg_parser.GetArgument("-L", 0));
+    } catch (std::exception& e) {
+        throw ArgumentException("-L expects a level");
+    }
+    if (lz_level < 1 or lz_level > MAX_LZ_LEVEL) {
+        throw ArgumentException("-L must be between 1 and " + std::to_string(MAX_LZ_LEVEL));
+    }
+    return lz_level;
+}
+
+int32_t ParseContextGroups(ArgParser& arg_parser) {
+    if (not arg_parser.HasField("-C")) {
+        return 0;
+    }
+    int32_t context_groups = 0;
+    try {
+        context_groups = std::stoi(arg_parser.GetArgument("-C", 0));
+    } catch (std::exception& e) {
+        throw ArgumentException("-C expects a number of context groups");
+    }
+    if (context_groups < 2 or context_groups > MAX_CONTEXT_GROUPS) {
+        throw ArgumentException("-C must be between 2 and " + std::to_string(MAX_CONTEXT_GROUPS));
+    }
+    if (arg_parser.HasField("-L")) {
+        throw ArgumentException("-C and -L cannot be combined");
+    }
+    return context_groups;
+}
+
+size_t ParseLzWindow(ArgParser& arg_parser) {
+    if (not arg_parser.HasField("-w")) {
+        return DEFAULT_LZ_WINDOW;
+    }
+    size_t window = ParseSize(arg_parser.GetArgument("-w", 0), "-w expects a window size");
+    if (window < MIN_LZ_WINDOW or window > MAX_BLOCK_SIZE) {
+        throw ArgumentException("-w must be between " + std::to_string(MIN_LZ_WINDOW >> 10) + "K and " +
+                                std::to_string(MAX_BLOCK_SIZE >> 20) + "M");
+    }
+    return window;
+}
+
+// Adds the files that follow the archive name of field, in solid groups with -S.
+void AddFiles(ArgParser& arg_parser, const std::string& field, ArchiveWriter& archive_writer) {
+    archive_writer.SetDeduplication(arg_parser.HasField("-u"));
+    std::vector<std::string> filenames;
+    for (size_t i = 1; i < arg_parser.GetCountOfArguments(field); ++i) {
+        filenames.push_back(arg_parser.GetArgument(field, i));
+    }
+    if (arg_parser.HasField("-S")) {
+        archive_writer.AddSolidFiles(filenames);
+    } else {
+        for (const std::string& filename : filenames) {
+            archive_writer.AddFile(filename);
+        }
+    }
+    archive_writer.Close();
+}
 
 int main(int argc, char** argv) {
     ArgParser arg_parser;
-    arg_parser.SetOptionalField("-c");
-    arg_parser.SetOptionalField("-d");
-    arg_parser.SetOptionalField("-h");
+    for (std::string field : {"-c", "-a", "-x", "-T"}) {
+        arg_parser.SetOptionalField(field);
+    }
+    for (std::string field : {"-d", "-t", "-l", "-m", "-b", "-j", "-s", "-L", "-w", "-C", "-D", "-B"}) {
+        arg_parser.SetOptionalField(field, 1);
+    }
+    for (std::string field : {"-S", "-u", "--stats", "--stats-json", "-h"}) {
+        arg_parser.SetOptionalField(field, 0);
+    }
 
+    CodingOptions options;
+    std::unique_ptr<Dictionary> dictionary;
+    size_t block_size = DEFAULT_BLOCK_SIZE;
+    size_t threads_count = 1;
+    size_t pipeline_buffer_size = DEFAULT_PIPELINE_BUFFER_SIZE;
     try {
         arg_parser.Parse(argc, argv);
+        options.max_code_length = ParseMaxCodeLength(arg_parser);
+        block_size = ParseBlockSize(arg_parser);
+        threads_count = ParseThreadsCount(arg_parser);
+        pipeline_buffer_size = ParsePipelineBufferSize(arg_parser);
+        options.streams_count = ParseStreamsCount(arg_parser);
+        options.lz_level = ParseLzLevel(arg_parser);
+        options.lz_window = ParseLzWindow(arg_parser);
+        options.context_groups = ParseContextGroups(arg_parser);
+        if (arg_parser.HasField("-D")) {
+            if (options.lz_level > 0 or options.context_groups > 0) {
+                throw ArgumentException("-D cannot be combined with -L or -C");
+            }
+            dictionary = std::make_unique<Dictionary>(LoadDictionary(arg_parser.GetArgument("-D", 0)));
+            options.dictionary = dictionary.get();
+        }
+        if (arg_parser.HasField("--stats") or arg_parser.HasField("--stats-json")) {
+            if (not STATISTICS_BUILT) {
+                throw ArgumentException("Statistics are not built into this archiver");
+            }
+            Statistics::Enable();
+        }
     } catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
         return 111;
@@ -17,29 +214,77 @@ int main(int argc, char** argv) {
         std::cerr << "At least one field must be added" << std::endl;
         return 111;
     }
-    std::string field = arg_parser.GetField();
-    if (field == "-c") {
-        std::string output_filename = arg_parser.GetArgument(field, 0);
-        BitWriter<std::ofstream> bit_writer(output_filename);
-        BitString global_bit_string(0, 0);
-        for (size_t i = 1; i < arg_parser.GetCountOfArguments(field); ++i) {
-            std::string input_filename = arg_parser.GetArgument(field, i);
-            BitReader<std::ifstream> bit_reader(input_filename);
-
-            HuffmanCoding<std::ifstream, std::ofstream> huffman_code;
-
-            bool is_file_last = (i + 1 == arg_parser.GetCountOfArguments(field));
-            huffman_code.EncodeFile(bit_reader, bit_writer, global_bit_string, input_filename, is_file_last);
+    int exit_code = 0;
+    try {
+        if (arg_parser.HasField("-c")) {
+            ArchiveWriter archive_writer(arg_parser.GetArgument("-c", 0), block_size, options, threads_count,
+                                         pipeline_buffer_size);
+            AddFiles(arg_parser, "-c", archive_writer);
+        } else if (arg_parser.HasField("-a")) {
+            std::string filename = arg_parser.GetArgument("-a", 0);
+            if (filename == "-") {
+                throw ArgumentException("-a needs an archive file, not stdin");
+            }
+            std::vector<MemberInfo> members;
+            uint64_t records_end = 0;
+            {
+                ArchiveReader archive_reader(filename);
+                members = archive_reader.ReadIndex();
+                records_end = archive_reader.RecordsEnd();
+                if (archive_reader.DictionaryId() != (dictionary != nullptr ? dictionary->GetId() : 0)) {
+                    throw ArgumentException("-a needs the -D dictionary the archive was made with, if any");
+                }
+            }
+            ArchiveWriter archive_writer(filename, std::move(members), records_end, block_size, options,
+                                         threads_count, pipeline_buffer_size);
+            AddFiles(arg_parser, "-a", archive_writer);
+        } else if (arg_parser.HasField("-T")) {
+            SymbolFrequencies frequency{};
+            for (size_t i = 1; i < arg_parser.GetCountOfArguments("-T"); ++i) {
+                MappedReader reader(arg_parser.GetArgument("-T", i));
+                const unsigned char* data = nullptr;
+                while (size_t size = reader.Read(data, DEFAULT_BLOCK_SIZE)) {
+                    CountBytes(data, size, frequency);
+                }
+            }
+            SaveDictionary(Dictionary::Train(frequency, options.max_code_length), arg_parser.GetArgument("-T", 0));
+        } else if (arg_parser.HasField("-d")) {
+            ArchiveReader archive_reader(arg_parser.GetArgument("-d", 0), threads_count, dictionary.get(),
+                                         pipeline_buffer_size);
+            archive_reader.ExtractAll();
+        } else if (arg_parser.HasField("-x")) {
+            ArchiveReader archive_reader(arg_parser.GetArgument("-x", 0), threads_count, dictionary.get(),
+                                         pipeline_buffer_size);
+            std::vector<std::string> names;
+            for (size_t i = 1; i < arg_parser.GetCountOfArguments("-x"); ++i) {
+                names.push_back(arg_parser.GetArgument("-x", i));
+            }
+            archive_reader.Extract(names);
+        } else if (arg_parser.HasField("-t")) {
+            ArchiveReader archive_reader(arg_parser.GetArgument("-t", 0), threads_count, dictionary.get(),
+                                         pipeline_buffer_size);
+            std::vector<std::string> damaged = archive_reader.Test();
+            for (const std::string& name : damaged) {
+                std::cerr << "Checksum mismatch in " << name << std::endl;
+            }
+            if (not damaged.empty()) {
+                exit_code = 111;
+            }
+        } else if (arg_parser.HasField("-l")) {
+            ArchiveReader archive_reader(arg_parser.GetArgument("-l", 0));
+            for (const MemberInfo& member : archive_reader.ReadIndex()) {
+                std::cout << member.original_size << '\t' << std::hex << std::setw(8) << std::setfill('0')
+                          << member.checksum << std::dec << '\t' << member.name << '\n';
+            }
+        } else {
+            arg_parser.PrintHelp();
         }
-    } else if (field == "-d") {
-        std::string input_filename = arg_parser.GetArgument(field, 0);
-        BitReader<std::ifstream> bit_reader(input_filename);
-        HuffmanCoding<std::ifstream, std::ofstream> huffman_code;
-        BitString global_bit_string(0, 0);
-        while (not huffman_code.DecodeFile(bit_reader, global_bit_string)) {
+        if (Statistics::IsEnabled()) {
+            Statistics::Report(std::cerr, arg_parser.HasField("--stats-json"));
         }
-    } else {
-        arg_parser.PrintHelp();
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 111;
     }
-    return 0;
+    return exit_code;
 }
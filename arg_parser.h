@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -19,6 +20,8 @@ private:
 
 class ArgParser {
 public:
+    static const size_t ANY_ARGUMENTS_COUNT = SIZE_MAX;
+
     ArgParser() {
     }
     void Parse(int argc, char** argv) {
@@ -27,10 +30,21 @@ public:
             if (not is_field_[field]) {
                 throw ArgumentException(field + " must be a field");
             }
+            std::vector<std::string>& arguments = arguments_[field];
             while (i + 1 < argc and not is_field_[std::string{argv[i + 1]}]) {
-                arguments_[field].push_back(std::string{argv[i + 1]});
+                arguments.push_back(std::string{argv[i + 1]});
                 ++i;
             }
+            // A switch or an option placed in front of files would otherwise take them as its own arguments.
+            size_t max_count = max_arguments_count_[field];
+            if (arguments.size() > max_count) {
+                std::string expected = "no arguments";
+                if (max_count > 0) {
+                    expected = max_count == 1 ? "one argument" : std::to_string(max_count) + " arguments";
+                }
+                throw ArgumentException("Unexpected argument " + arguments[max_count] + " after " + field +
+                                        ", which takes " + expected);
+            }
         }
         for (const auto& field : positional_fields_) {
             if (arguments_.find(field) == arguments_.end()) {
@@ -41,33 +55,70 @@ public:
     std::string GetField() {
         return arguments_.begin()->first;
     }
+    bool HasField(std::string field) {
+        return arguments_.find(field) != arguments_.end();
+    }
     std::string GetArgument(std::string field, size_t position) {
+        if (position >= arguments_[field].size()) {
+            throw ArgumentException(field + " expects an argument");
+        }
         return arguments_[field][position];
     }
     size_t GetCountOfArguments(std::string field) {
         return arguments_[field].size();
     }
-    void SetPositionalField(std::string name) {
-        is_field_[name] = true;
+    void SetPositionalField(std::string name, size_t max_arguments_count = ANY_ARGUMENTS_COUNT) {
+        SetOptionalField(name, max_arguments_count);
         positional_fields_.push_back(name);
     }
-    void SetOptionalField(std::string name) {
+    // A field takes at most max_arguments_count of the arguments that follow it; more is an error.
+    void SetOptionalField(std::string name, size_t max_arguments_count = ANY_ARGUMENTS_COUNT) {
         is_field_[name] = true;
+        max_arguments_count_[name] = max_arguments_count;
     }
     bool Empty() {
         return arguments_.empty();
     }
     void PrintHelp() {
         std::cerr << "Usage:" << '\n';
-        std::cerr << "\t./archiver [option] file1 [files]:" << '\n';
+        std::cerr << "\t./archiver -c archive file1 [files] [-m length] [-b size] [-s streams] [-L level] [-w window]"
+                  << " [-C groups] [-D dictionary] [-S] [-u] [-j threads] [-B size]" << '\n';
+        std::cerr << "\t./archiver -a archive file1 [files] [options of -c]" << '\n';
+        std::cerr << "\t./archiver -d archive [-D dictionary] [-j threads] [-B size]" << '\n';
+        std::cerr << "\t./archiver -x archive file1 [files] [-D dictionary] [-j threads] [-B size]" << '\n';
+        std::cerr << "\t./archiver -t archive [-D dictionary] [-j threads] [-B size]" << '\n';
+        std::cerr << "\t./archiver -T dictionary sample1 [samples] [-m length]" << '\n';
+        std::cerr << "\t./archiver -l archive" << '\n';
+        std::cerr << "\t\"-\" stands for stdin or stdout in place of the archive or a file" << '\n';
         std::cerr << "Options:" << '\n';
         std::cerr << "\t -c \t\t encoding files" << '\n';
+        std::cerr << "\t -a \t\t encoding files at the end of an existing archive" << '\n';
         std::cerr << "\t -d \t\t decoding files" << '\n';
+        std::cerr << "\t -x \t\t decoding only the named files" << '\n';
+        std::cerr << "\t -t \t\t decoding every file and checking its CRC-32C without writing anything" << '\n';
+        std::cerr << "\t -l \t\t listing size, CRC-32C and name of every file" << '\n';
+        std::cerr << "\t -T \t\t training a dictionary on sample files" << '\n';
+        std::cerr << "\t -m length \t limit code lengths to the given number of bits (9-32) when encoding" << '\n';
+        std::cerr << "\t -b size \t block size in bytes, K or M suffix allowed (4K-64M, default 1M)" << '\n';
+        std::cerr << "\t -s streams \t split every block into 1, 4 or 8 streams that decode in parallel" << '\n';
+        std::cerr << "\t -L level \t find repeated strings before Huffman coding, 1 (fastest) to 9 (smallest)" << '\n';
+        std::cerr << "\t -w window \t how far back -L looks for a match, K or M suffix allowed (1K-64M, default 256K)"
+                  << '\n';
+        std::cerr << "\t -C groups \t code every byte by the byte before it, with up to 2-16 codes per block" << '\n';
+        std::cerr << "\t -D dictionary \t code every block with a trained table instead of a table of its own" << '\n';
+        std::cerr << "\t -S \t\t solid mode: code the files as one stream that shares blocks and tables" << '\n';
+        std::cerr << "\t -u \t\t store repeated files and blocks as references to their first copy" << '\n';
+        std::cerr << "\t -j threads \t code blocks on the given number of threads, 0 for all cores" << '\n';
+        std::cerr << "\t -B size \t I/O buffer size of the reader and writer threads, 0 for none (64K-16M, default 4M)"
+                  << '\n';
+        std::cerr << "\t --stats \t print time per stage, I/O counts and per-file entropy to stderr" << '\n';
+        std::cerr << "\t --stats-json \t the same report as JSON" << '\n';
         std::cerr << "\t -h \t\t print help" << '\n';
     }
 
 private:
     std::unordered_map<std::string, std::vector<std::string>> arguments_;
     std::unordered_map<std::string, bool> is_field_;
+    std::unordered_map<std::string, size_t> max_arguments_count_;
     std::vector<std::string> positional_fields_;
 };
@@ -0,0 +1,358 @@
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <random>
+
+#include <sys/resource.h>
+
+#include "arg_parser.h"
+#include "archive.h"
+
+const uint64_t CORPUS_SEED = 20240601;
+const size_t DEFAULT_CORPUS_SIZE = 16;
+const size_t DEFAULT_HUGE_FILE_SIZE = 128;
+const int32_t DEFAULT_RUNS_COUNT = 3;
+const int32_t TINY_FILES_COUNT = 2000;
+const size_t TINY_FILE_MAX_SIZE = 4096;
+const size_t MEGABYTE = 1 << 20;
+
+const char *const WORDS[] = {
+    "the",   "of",    "and",   "to",    "a",     "in",    "is",     "it",     "you",     "that",  "he",
+    "was",   "for",   "on",    "are",   "with",  "as",    "his",    "they",   "be",      "at",    "one",
+    "have",  "this",  "from",  "or",    "had",   "by",    "word",   "but",    "what",    "some",  "we",
+    "can",   "out",   "other", "were",  "all",   "there", "when",   "up",     "use",     "your",  "how",
+    "said",  "an",    "each",  "she",   "which", "do",    "their",  "time",   "if",      "will",  "way",
+    "about", "many",  "then",  "them",  "write", "would", "like",   "so",     "these",   "her",   "long",
+    "make",  "thing", "see",   "him",   "two",   "has",   "look",   "more",   "day",     "could", "go",
+    "come",  "did",   "sound", "no",    "most",  "people", "over",  "know",   "water",   "than",  "call",
+    "first", "who",   "may",   "down",  "side",  "been",  "now",    "find",   "archive", "block", "table",
+};
+const int32_t WORDS_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+// Synthetic inputs that are the same on every platform: only the raw output of mt19937_64 is used, whose sequence
+// is fixed by the standard, unlike the distributions built on top of it.
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(uint64_t seed) : random_(seed) {
+    }
+    std::vector<unsigned char> Uniform(size_t size) {
+        std::vector<unsigned char> data(size);
+        for (unsigned char &byte : data) {
+            byte = static_cast<unsigned char>(random_() >> 56);
+        }
+        return data;
+    }
+    // Words drawn with a skew towards the start of the list, in lines of about 80 characters.
+    std::vector<unsigned char> Text(size_t size) {
+        std::vector<unsigned char> data;
+        data.reserve(size + 16);
+        size_t line_length = 0;
+        bool is_sentence_start = true;
+        while (data.size() < size) {
+            uint64_t bits = random_();
+            const char *word = WORDS[(bits % WORDS_COUNT) * ((bits >> 16) % WORDS_COUNT) / WORDS_COUNT];
+            for (size_t i = 0; word[i] != '\0'; ++i) {
+                data.push_back(is_sentence_start and i == 0 ? word[i] - 'a' + 'A' : word[i]);
+            }
+            line_length += std::char_traits<char>::length(word) + 1;
+            is_sentence_start = (bits >> 32) % 12 == 0;
+            if (is_sentence_start) {
+                data.push_back('.');
+            } else if ((bits >> 40) % 16 == 0) {
+                data.push_back(',');
+            }
+            if (line_length > 80) {
+                data.push_back('\n');
+                line_length = 0;
+            } else {
+                data.push_back(' ');
+            }
+        }
+        data.resize(size);
+        return data;
+    }
+    // Symbol k appears with probability 2^-(k+1), so a few symbols dominate and codes get long.
+    std::vector<unsigned char> Skewed(size_t size) {
+        std::vector<unsigned char> data(size);
+        for (unsigned char &byte : data) {
+            byte = static_cast<unsigned char>(__builtin_ctzll(random_() | (1ull << 63)));
+        }
+        return data;
+    }
+    // Mostly zeros with one random byte in sixteen.
+    std::vector<unsigned char> Sparse(size_t size) {
+        std::vector<unsigned char> data(size);
+        for (unsigned char &byte : data) {
+            uint64_t bits = random_();
+            byte = bits % 16 == 0 ? static_cast<unsigned char>(bits >> 56) : 0;
+        }
+        return data;
+    }
+    size_t Size(size_t max_size) {
+        return 1 + random_() % max_size;
+    }
+
+private:
+    std::mt19937_64 random_;
+};
+
+struct Corpus {
+    std::string name;
+    std::vector<std::string> file_names;
+    std::vector<std::vector<unsigned char>> files;
+};
+
+std::vector<Corpus> GenerateCorpora(size_t corpus_size, size_t huge_file_size) {
+    CorpusGenerator generator(CORPUS_SEED);
+    std::vector<Corpus> corpora;
+    corpora.push_back(Corpus{"uniform", {"uniform.bin"}, {generator.Uniform(corpus_size)}});
+    corpora.push_back(Corpus{"text", {"text.txt"}, {generator.Text(corpus_size)}});
+    corpora.push_back(Corpus{"skewed", {"skewed.bin"}, {generator.Skewed(corpus_size)}});
+    corpora.push_back(Corpus{"sparse", {"sparse.bin"}, {generator.Sparse(corpus_size)}});
+    Corpus tiny_files{"tiny_files", {}, {}};
+    for (int32_t i = 0; i < TINY_FILES_COUNT; ++i) {
+        tiny_files.file_names.push_back("tiny_" + std::to_string(i) + ".txt");
+        tiny_files.files.push_back(generator.Text(generator.Size(TINY_FILE_MAX_SIZE)));
+    }
+    corpora.push_back(std::move(tiny_files));
+    corpora.push_back(Corpus{"huge_file", {"huge.txt"}, {generator.Text(huge_file_size)}});
+    return corpora;
+}
+
+struct StageTimes {
+    double histogram = 0;
+    double tree = 0;
+    double encode = 0;
+    double decode = 0;
+};
+
+struct BenchmarkResult {
+    std::string corpus;
+    size_t files_count = 0;
+    size_t original_size = 0;
+    size_t encoded_size = 0;
+    StageTimes seconds;
+    long peak_rss_kb = 0;
+};
+
+// Best time of runs_count calls, which filters out most of the noise of a shared machine.
+double MeasureBest(int32_t runs_count, const std::function<void()> &stage) {
+    double best = 0;
+    for (int32_t run = 0; run < runs_count; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        stage();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (run == 0 or seconds < best) {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+long PeakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Runs every stage over the blocks the archiver would code: each file cut into blocks of block_size.
+BenchmarkResult RunBenchmark(const Corpus &corpus, size_t block_size, const CodingOptions &options,
+                             int32_t runs_count) {
+    struct Block {
+        const unsigned char *data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    BenchmarkResult result;
+    result.corpus = corpus.name;
+    result.files_count = corpus.files.size();
+    for (const auto &file : corpus.files) {
+        for (size_t position = 0; position < file.size(); position += block_size) {
+            blocks.push_back(Block{file.data() + position, std::min(block_size, file.size() - position)});
+        }
+        result.original_size += file.size();
+    }
+
+    std::vector<SymbolFrequencies> frequencies(blocks.size());
+    result.seconds.histogram = MeasureBest(runs_count, [&] {
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            frequencies[i].fill(0);
+            CountBytes(blocks[i].data, blocks[i].size, frequencies[i]);
+        }
+    });
+    HuffmanTree huffman_tree;
+    result.seconds.tree = MeasureBest(runs_count, [&] {
+        SymbolLengths code_length;
+        SymbolList symbols;
+        SymbolCodes code;
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            int32_t symbols_count = huffman_tree.Build(frequencies[i], ALPHABET_SIZE, MAX_CODE_LENGTH, code_length,
+                                                       symbols);
+            SetCanonicalCodes(code_length, symbols, symbols_count, code);
+        }
+    });
+    std::vector<BufferWriter> payloads(blocks.size());
+    HuffmanCoding encoder(options);
+    result.seconds.encode = MeasureBest(runs_count, [&] {
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            payloads[i].Clear();
+            encoder.EncodeBlock(blocks[i].data, blocks[i].size, payloads[i]);
+        }
+    });
+    for (const BufferWriter &payload : payloads) {
+        result.encoded_size += payload.Size();
+    }
+    std::vector<unsigned char> output(block_size);
+    HuffmanCoding decoder;
+    bool is_restored = true;
+    result.seconds.decode = MeasureBest(runs_count, [&] {
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            decoder.DecodeBlock(reinterpret_cast<const unsigned char *>(payloads[i].Data()), payloads[i].Size(),
+                                output.data(), blocks[i].size);
+            is_restored &= std::equal(output.begin(), output.begin() + blocks[i].size, blocks[i].data);
+        }
+    });
+    if (not is_restored) {
+        throw ArchiveException("Decoded " + corpus.name + " does not match the original");
+    }
+    result.peak_rss_kb = PeakRssKb();
+    return result;
+}
+
+double Throughput(size_t size, double seconds) {
+    return seconds > 0 ? size / seconds / MEGABYTE : 0;
+}
+
+void PrintCsvHeader() {
+    std::cout << "corpus,files,original_bytes,encoded_bytes,ratio,histogram_mb_s,tree_mb_s,encode_mb_s,decode_mb_s,"
+                 "peak_rss_kb\n";
+}
+
+void PrintCsv(const BenchmarkResult &result) {
+    std::cout << result.corpus << ',' << result.files_count << ',' << result.original_size << ','
+              << result.encoded_size << ',' << static_cast<double>(result.encoded_size) / result.original_size << ','
+              << Throughput(result.original_size, result.seconds.histogram) << ','
+              << Throughput(result.original_size, result.seconds.tree) << ','
+              << Throughput(result.original_size, result.seconds.encode) << ','
+              << Throughput(result.original_size, result.seconds.decode) << ',' << result.peak_rss_kb << '\n';
+}
+
+void PrintJson(const BenchmarkResult &result, bool is_last) {
+    std::cout << "  {\"corpus\": \"" << result.corpus << "\", \"files\": " << result.files_count
+              << ", \"original_bytes\": " << result.original_size << ", \"encoded_bytes\": " << result.encoded_size
+              << ", \"ratio\": " << static_cast<double>(result.encoded_size) / result.original_size
+              << ", \"histogram_mb_s\": " << Throughput(result.original_size, result.seconds.histogram)
+              << ", \"tree_mb_s\": " << Throughput(result.original_size, result.seconds.tree)
+              << ", \"encode_mb_s\": " << Throughput(result.original_size, result.seconds.encode)
+              << ", \"decode_mb_s\": " << Throughput(result.original_size, result.seconds.decode)
+              << ", \"peak_rss_kb\": " << result.peak_rss_kb << "}" << (is_last ? "\n" : ",\n");
+}
+
+// Writes the corpora as files, so the same inputs can be fed to the archiver itself.
+void WriteCorpora(const std::vector<Corpus> &corpora, const std::string &directory) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        throw FileException("Cannot create " + directory);
+    }
+    for (const Corpus &corpus : corpora) {
+        for (size_t i = 0; i < corpus.files.size(); ++i) {
+            FileWriter file_writer(directory + "/" + corpus.file_names[i]);
+            file_writer.Write(reinterpret_cast<const char *>(corpus.files[i].data()), corpus.files[i].size());
+            file_writer.Close();
+        }
+    }
+}
+
+size_t ParseNumber(ArgParser &arg_parser, std::string field, size_t default_value, size_t min_value,
+                   size_t max_value) {
+    if (not arg_parser.HasField(field)) {
+        return default_value;
+    }
+    size_t value = 0;
+    try {
+        value = std::stoull(arg_parser.GetArgument(field, 0));
+    } catch (std::exception &e) {
+        throw ArgumentException(field + " expects a number");
+    }
+    if (value < min_value or value > max_value) {
+        throw ArgumentException(field + " must be between " + std::to_string(min_value) + " and " +
+                                std::to_string(max_value));
+    }
+    return value;
+}
+
+void PrintHelp() {
+    std::cerr << "Usage:" << '\n';
+    std::cerr << "\t./benchmark [-f json|csv] [-n size] [-g size] [-r runs] [-b size] [-s streams] [-L level]"
+              << " [-C groups]" << '\n';
+    std::cerr << "\t./benchmark -o directory [-n size] [-g size]" << '\n';
+    std::cerr << "Options:" << '\n';
+    std::cerr << "\t -f format \t output format, json (default) or csv" << '\n';
+    std::cerr << "\t -n size \t size of every single-file corpus in MB (default 16)" << '\n';
+    std::cerr << "\t -g size \t size of the huge file in MB (default 128)" << '\n';
+    std::cerr << "\t -r runs \t runs of every stage, the best one is reported (default 3)" << '\n';
+    std::cerr << "\t -b size \t block size in KB (default 1024)" << '\n';
+    std::cerr << "\t -s streams \t streams per block, 1, 4 or 8 (default 1)" << '\n';
+    std::cerr << "\t -L level \t LZ77 level of the encode stage, 0 (off, default) to 9" << '\n';
+    std::cerr << "\t -C groups \t order-1 context groups of the encode stage, 0 (off, default) to 16" << '\n';
+    std::cerr << "\t -o directory \t write the corpus files, creating the directory if missing, instead of measuring"
+              << '\n';
+}
+
+int main(int argc, char **argv) {
+    ArgParser arg_parser;
+    for (std::string field : {"-f", "-n", "-g", "-r", "-b", "-s", "-L", "-C", "-o"}) {
+        arg_parser.SetOptionalField(field, 1);
+    }
+    try {
+        arg_parser.Parse(argc, argv);
+        std::string format = arg_parser.HasField("-f") ? arg_parser.GetArgument("-f", 0) : "json";
+        if (format != "json" and format != "csv") {
+            throw ArgumentException("-f must be json or csv");
+        }
+        size_t corpus_size = ParseNumber(arg_parser, "-n", DEFAULT_CORPUS_SIZE, 1, 1024) * MEGABYTE;
+        size_t huge_file_size = ParseNumber(arg_parser, "-g", DEFAULT_HUGE_FILE_SIZE, 1, 4096) * MEGABYTE;
+        int32_t runs_count = ParseNumber(arg_parser, "-r", DEFAULT_RUNS_COUNT, 1, 100);
+        size_t block_size = ParseNumber(arg_parser, "-b", DEFAULT_BLOCK_SIZE >> 10, MIN_BLOCK_SIZE >> 10,
+                                        MAX_BLOCK_SIZE >> 10) << 10;
+        CodingOptions options;
+        options.streams_count = ParseNumber(arg_parser, "-s", 1, 1, MAX_STREAMS_COUNT);
+        if (options.streams_count != 1 and options.streams_count != 4 and options.streams_count != MAX_STREAMS_COUNT) {
+            throw ArgumentException("-s must be 1, 4 or " + std::to_string(MAX_STREAMS_COUNT));
+        }
+        options.lz_level = ParseNumber(arg_parser, "-L", 0, 0, MAX_LZ_LEVEL);
+        options.context_groups = ParseNumber(arg_parser, "-C", 0, 0, MAX_CONTEXT_GROUPS);
+
+        std::vector<Corpus> corpora = GenerateCorpora(corpus_size, huge_file_size);
+        if (arg_parser.HasField("-o")) {
+            WriteCorpora(corpora, arg_parser.GetArgument("-o", 0));
+            return 0;
+        }
+        if (format == "csv") {
+            PrintCsvHeader();
+        } else {
+            std::cout << "[\n";
+        }
+        for (size_t i = 0; i < corpora.size(); ++i) {
+            BenchmarkResult result = RunBenchmark(corpora[i], block_size, options, runs_count);
+            if (format == "csv") {
+                PrintCsv(result);
+            } else {
+                PrintJson(result, i + 1 == corpora.size());
+            }
+            std::cout.flush();
+        }
+        if (format == "json") {
+            std::cout << "]\n";
+        }
+    } catch (ArgumentException &e) {
+        std::cerr << e.what() << std::endl;
+        PrintHelp();
+        return 111;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 111;
+    }
+    return 0;
+}
@@ -1,111 +1,162 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
-#include <fstream>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
 
-template <typename Stream>
-class BitReader {
+class ArchiveException : public std::exception {
 public:
-    explicit BitReader(std::string filename) : filename_(filename) {
-        stream_.open(filename, std::ios::in | std::ios::binary);
-        current_index_ = 0;
-        FillBuffer();
+    explicit ArchiveException(const std::string& message) : message_(message) {
     }
-    ~BitReader() {
-        stream_.close();
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+// Reads bytes that are already in memory, such as a block payload inside a mapped archive.
+class MemoryReader {
+public:
+    MemoryReader() : MemoryReader(nullptr, 0) {
+    }
+    MemoryReader(const unsigned char *data, size_t size) : data_(data), size_(size) {
     }
     unsigned char ReadNext() {
-        unsigned char next_symbol = 0;
-        if (buffer_[current_index_] < 0) {
-            next_symbol = buffer_[current_index_];
-        } else {
-            next_symbol = 256 + buffer_[current_index_];
-        }
-        ++current_index_;
-        --byte_count_;
-        if (current_index_ == BUFFER_SIZE) {
-            FillBuffer();
-            current_index_ = 0;
-        }
-        return next_symbol;
+        return position_ < size_ ? data_[position_++] : 0;
     }
-    void FillBuffer() {
-        stream_.read(buffer_, BUFFER_SIZE);
-        byte_count_ = stream_.gcount();
+    size_t ReadChunk(const unsigned char *&data) {
+        data = data_ + position_;
+        size_t size = size_ - position_;
+        position_ = size_;
+        return size;
     }
     void Reset() {
-        stream_ = Stream(filename_, std::ios::in | std::ios::binary);
-        current_index_ = 0;
-        FillBuffer();
+        position_ = 0;
+    }
+    bool Empty() const {
+        return position_ == size_;
+    }
+    const unsigned char *Data() const {
+        return data_;
     }
-    bool Empty() {
-        return byte_count_ == 0;
+    size_t Size() const {
+        return size_;
+    }
+    size_t Position() const {
+        return position_;
+    }
+    void Seek(size_t position) {
+        position_ = std::min(position, size_);
     }
 
 private:
-    std::string filename_;
-    static const int16_t BUFFER_SIZE = 1024;
-    char buffer_[BUFFER_SIZE];
-    int16_t byte_count_;
-    int16_t current_index_;
-    Stream stream_;
+    const unsigned char *data_;
+    size_t size_;
+    size_t position_ = 0;
 };
 
-template <typename Stream>
-class BitWriter {
+// Collects output in a growable buffer that keeps its capacity across Clear calls.
+class BufferWriter {
 public:
-    explicit BitWriter(std::string filename) {
-        Open(filename);
-    }
-    ~BitWriter() {
-        Close();
+    BufferWriter() {
     }
     void WriteNext(char symbol) {
-        buffer_[current_index_] = symbol;
-        ++current_index_;
-        ++byte_count_;
-        if (current_index_ == BUFFER_SIZE) {
-            OutBuffer();
-            current_index_ = 0;
+        Reserve(1)[0] = symbol;
+        ++size_;
+    }
+    void Write(const char *data, size_t size) {
+        std::copy(data, data + size, Reserve(size));
+        size_ += size;
+    }
+    // Returns room for at least size bytes; Commit reports how many of them were filled.
+    char *Reserve(size_t size) {
+        if (buffer_.size() - size_ < size) {
+            buffer_.resize(std::max(2 * buffer_.size(), size_ + size));
         }
+        return buffer_.data() + size_;
+    }
+    void Commit(size_t size) {
+        size_ += size;
     }
-    void OutBuffer() {
-        stream_.write(buffer_, byte_count_);
-        byte_count_ = 0;
+    const char *Data() const {
+        return buffer_.data();
     }
-    void Open(std::string filename) {
-        stream_.open(filename, std::ios::out | std::ios::binary);
-        current_index_ = 0;
+    char *Data() {
+        return buffer_.data();
+    }
+    size_t Size() const {
+        return size_;
+    }
+    void Clear() {
+        size_ = 0;
+    }
+
+private:
+    std::vector<char> buffer_;
+    size_t size_ = 0;
+};
+
+// Counts the bytes written to it, for sizing output without producing it.
+class ByteCounter {
+public:
+    void WriteNext(char) {
+        ++size_;
     }
-    void Close() {
-        OutBuffer();
-        stream_.close();
+    size_t Size() const {
+        return size_;
     }
 
 private:
-    static const int16_t BUFFER_SIZE = 1024;
-    char buffer_[BUFFER_SIZE];
-    int16_t byte_count_ = 0;
-    int16_t current_index_ = 0;
-    Stream stream_;
+    size_t size_ = 0;
 };
 
 class BitString {
 public:
+    // Refill leaves at least this many bits unless the reader runs out.
+    static constexpr int32_t REFILLED_LENGTH = 57;
+
+    BitString() : BitString(0, 0) {
+    }
     BitString(int32_t bit_string_length, int32_t bit_string)
         : bit_string_length_(bit_string_length), bit_string_(bit_string) {
     }
-    void AddBits(int32_t bits_count, int32_t bits) {
+    void AddBits(int32_t bits_count, uint32_t bits) {
         bit_string_length_ += bits_count;
         bit_string_ <<= bits_count;
         bit_string_ |= bits;
     }
-    int16_t GetBits(int32_t bits_length) {
+    uint32_t GetBits(int32_t bits_length) {
         int32_t residual_bits_count = bit_string_length_ - bits_length;
         bit_string_length_ -= bits_length;
-        int16_t byte = static_cast<int16_t>(bit_string_ >> residual_bits_count);
-        bit_string_ &= (1ll << residual_bits_count) - 1;
-        return byte;
+        uint32_t bits = static_cast<uint32_t>(bit_string_ >> residual_bits_count);
+        bit_string_ &= (1ull << residual_bits_count) - 1;
+        return bits;
+    }
+    uint64_t PeekBits(int32_t bits_length) const {
+        if (bit_string_length_ >= bits_length) {
+            return bit_string_ >> (bit_string_length_ - bits_length);
+        }
+        return bit_string_ << (bits_length - bit_string_length_);
+    }
+    // A code longer than the bits left means the block ended in the middle of it.
+    void SkipBits(int32_t bits_length) {
+        if (bits_length > bit_string_length_) {
+            throw ArchiveException("Unexpected end of block");
+        }
+        bit_string_length_ -= bits_length;
+        bit_string_ &= (1ull << bit_string_length_) - 1;
+    }
+    template <typename Reader>
+    void Refill(Reader &bit_reader) {
+        while (bit_string_length_ <= MAX_LENGTH - BYTE_LENGTH and not bit_reader.Empty()) {
+            AddBits(BYTE_LENGTH, bit_reader.ReadNext());
+        }
     }
     bool IsResidueFull(int32_t bits_length) const {
         return bit_string_length_ >= bits_length;
@@ -113,15 +164,101 @@ public:
     int32_t GetLength() const {
         return bit_string_length_;
     }
-    template <typename T>
-    void Update(BitWriter<T> &bit_writer, int32_t bits_count, int32_t bits) {
+    template <typename Writer>
+    void Update(Writer &bit_writer, int32_t bits_count, uint32_t bits) {
         AddBits(bits_count, bits);
         while (IsResidueFull(8)) {
             bit_writer.WriteNext(GetBits(8));
         }
     }
+    // Pads the pending bits with zeros up to a byte boundary and writes them out.
+    template <typename Writer>
+    void Flush(Writer &bit_writer) {
+        if (bit_string_length_ > 0) {
+            Update(bit_writer, BYTE_LENGTH - bit_string_length_, 0);
+        }
+    }
+
+    // Appends the codes of count symbols, flushing 32-bit words straight into the writer's buffer. No code may be
+    // longer than max_length bits, which bounds how many codes fit between two checks for a whole word.
+    template <typename Writer>
+    void Encode(Writer &bit_writer, const unsigned char *symbols, size_t count, const int16_t *code_length,
+                const uint32_t *code, int32_t max_length = MAX_CODE_BITS) {
+        EncodeCodes(bit_writer, count, max_length, [symbols, code_length, code](size_t i, int32_t &length) {
+            length = code_length[symbols[i]];
+            return code[symbols[i]];
+        });
+    }
+    // Same as Encode, but every symbol is coded with the tables of the symbol before it, so symbols[-1] must exist.
+    template <typename Writer>
+    void EncodeInContext(Writer &bit_writer, const unsigned char *symbols, size_t count,
+                         const int16_t *const *code_length, const uint32_t *const *code,
+                         int32_t max_length = MAX_CODE_BITS) {
+        EncodeCodes(bit_writer, count, max_length, [symbols, code_length, code](size_t i, int32_t &length) {
+            length = code_length[symbols[i - 1]][symbols[i]];
+            return code[symbols[i - 1]][symbols[i]];
+        });
+    }
 
 private:
+    // After a flush fewer than 32 bits are pending, so 32 more fit in the 64-bit accumulator: three codes of up to
+    // 10 bits, two of up to 16 or one of up to 32 go in before the next check.
+    template <typename Writer, typename CodeOf>
+    void EncodeCodes(Writer &bit_writer, size_t count, int32_t max_length, CodeOf code_of) {
+        if (max_length <= 10) {
+            EncodeCodesBy<3>(bit_writer, count, code_of);
+        } else if (max_length <= 16) {
+            EncodeCodesBy<2>(bit_writer, count, code_of);
+        } else {
+            EncodeCodesBy<1>(bit_writer, count, code_of);
+        }
+    }
+    template <int32_t CODES_PER_CHECK, typename Writer, typename CodeOf>
+    void EncodeCodesBy(Writer &bit_writer, size_t count, CodeOf code_of) {
+        uint64_t bits = bit_string_;
+        int32_t length = bit_string_length_;
+        for (size_t begin = 0; begin < count; begin += ENCODE_CHUNK) {
+            size_t end = std::min(count, begin + ENCODE_CHUNK);
+            unsigned char *first = reinterpret_cast<unsigned char *>(bit_writer.Reserve((end - begin) * 4 + 8));
+            unsigned char *out = first;
+            size_t i = begin;
+            auto add_codes = [&bits, &length, &out, &i, &code_of](int32_t codes_count) {
+                for (int32_t j = 0; j < codes_count; ++j, ++i) {
+                    int32_t code_length = 0;
+                    uint32_t code = code_of(i, code_length);
+                    bits = (bits << code_length) | code;
+                    length += code_length;
+                }
+                if (length >= 32) {
+                    length -= 32;
+                    uint32_t word = static_cast<uint32_t>(bits >> length);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                    word = __builtin_bswap32(word);
+#endif
+                    std::memcpy(out, &word, sizeof(word));
+                    out += 4;
+                }
+            };
+            while (end - i >= CODES_PER_CHECK) {
+                add_codes(CODES_PER_CHECK);
+            }
+            while (i < end) {
+                add_codes(1);
+            }
+            while (length >= BYTE_LENGTH) {
+                length -= BYTE_LENGTH;
+                *out++ = static_cast<unsigned char>(bits >> length);
+            }
+            bit_writer.Commit(out - first);
+        }
+        bit_string_ = bits & ((1ull << length) - 1);
+        bit_string_length_ = length;
+    }
+
+    static const int32_t MAX_LENGTH = 64;
+    static const int32_t BYTE_LENGTH = 8;
+    static constexpr size_t ENCODE_CHUNK = 4096;
+    static const int32_t MAX_CODE_BITS = 32;
     int32_t bit_string_length_;
-    int64_t bit_string_;
+    uint64_t bit_string_;
 };
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+const size_t MIN_PIPELINE_BUFFER_SIZE = 1 << 16;
+const size_t MAX_PIPELINE_BUFFER_SIZE = 1 << 24;
+const size_t DEFAULT_PIPELINE_BUFFER_SIZE = 1 << 22;
+const size_t PIPELINE_BUFFERS_COUNT = 4;
+
+// Fixed ring of large buffers between one producer and one consumer thread, so that an I/O thread and the thread
+// that computes overlap: either side waits only while the ring is full or empty. The producer fills the buffer
+// returned by AcquireEmpty and hands it over with Push; the consumer takes buffers in the same order with
+// AcquireFull and gives them back with Release. Finish ends the data after the buffers already pushed, Abort stops
+// both sides at once.
+class BufferRing {
+public:
+    BufferRing(size_t buffers_count, size_t buffer_size)
+        : buffers_(buffers_count), sizes_(buffers_count), buffer_size_(buffer_size) {
+        for (std::unique_ptr<char[]> &buffer : buffers_) {
+            buffer.reset(new char[buffer_size]);
+        }
+    }
+    BufferRing(const BufferRing &) = delete;
+    BufferRing &operator=(const BufferRing &) = delete;
+    size_t BufferSize() const {
+        return buffer_size_;
+    }
+    // Returns the next buffer to fill, or nullptr once the ring is aborted.
+    char *AcquireEmpty() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] { return aborted_ or full_count_ < buffers_.size(); });
+        if (aborted_) {
+            return nullptr;
+        }
+        return buffers_[(first_full_ + full_count_) % buffers_.size()].get();
+    }
+    void Push(size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sizes_[(first_full_ + full_count_) % buffers_.size()] = size;
+            ++full_count_;
+        }
+        changed_.notify_all();
+    }
+    // True while the consumer waits for data, so a producer can hand over a partly filled buffer instead of
+    // keeping it waiting until the buffer is full.
+    bool IsStarving() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return starving_;
+    }
+    // Returns the oldest filled buffer and sets size to its length, or returns nullptr at the end of the data or
+    // once the ring is aborted.
+    const char *AcquireFull(size_t &size) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        starving_ = true;
+        changed_.wait(lock, [this] { return aborted_ or finished_ or full_count_ > 0; });
+        starving_ = false;
+        if (aborted_ or full_count_ == 0) {
+            return nullptr;
+        }
+        size = sizes_[first_full_];
+        return buffers_[first_full_].get();
+    }
+    void Release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            first_full_ = (first_full_ + 1) % buffers_.size();
+            --full_count_;
+        }
+        changed_.notify_all();
+    }
+    void Finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished_ = true;
+        }
+        changed_.notify_all();
+    }
+    void Abort() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            aborted_ = true;
+        }
+        changed_.notify_all();
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]>> buffers_;
+    std::vector<size_t> sizes_;
+    size_t buffer_size_;
+    size_t first_full_ = 0;
+    size_t full_count_ = 0;
+    bool finished_ = false;
+    bool aborted_ = false;
+    bool starving_ = false;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+};
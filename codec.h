@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bit_handler.h"
+#include "huffman_coding.h"
+
+// Block stream, the body of every archive member and the output of Compressor, all integers little-endian:
+//   block* end:u32 = 0
+// where every block is raw_size:u32 (> 0) payload_size:u32 payload, and the payload is a HuffmanCoding block.
+const size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+const size_t MIN_BLOCK_SIZE = 1 << 12;
+const size_t MAX_BLOCK_SIZE = 1 << 26;
+const size_t BLOCK_HEADER_SIZE = 8;
+// Bound on the code tables and stream sizes a payload may add to four bytes per raw byte.
+const size_t MAX_PAYLOAD_OVERHEAD = 1024;
+
+template <typename Writer>
+void WriteInteger(Writer &writer, uint64_t value, int32_t bytes_count) {
+    for (int32_t i = 0; i < bytes_count; ++i) {
+        writer.WriteNext(static_cast<char>(value >> (BYTE * i)));
+    }
+}
+
+inline uint64_t LoadInteger(const unsigned char *data, int32_t bytes_count) {
+    uint64_t value = 0;
+    for (int32_t i = bytes_count - 1; i >= 0; --i) {
+        value = (value << BYTE) | data[i];
+    }
+    return value;
+}
+
+inline void CheckBlockSizes(size_t size, size_t payload_size) {
+    if (size > MAX_BLOCK_SIZE or payload_size > 4 * size + MAX_PAYLOAD_OVERHEAD) {
+        throw ArchiveException("Corrupted archive: block is too large");
+    }
+}
+
+template <typename Writer>
+void WriteBlock(Writer &writer, const unsigned char *data, size_t size, HuffmanCoding &huffman_code) {
+    WriteInteger(writer, size, 4);
+    size_t payload_size_position = writer.Size();
+    WriteInteger(writer, 0, 4);
+    huffman_code.EncodeBlock(data, size, writer);
+    size_t payload_size = writer.Size() - payload_size_position - 4;
+    for (int32_t i = 0; i < 4; ++i) {
+        writer.Data()[payload_size_position + i] = static_cast<char>(payload_size >> (BYTE * i));
+    }
+}
+
+// Compresses data held in memory into a block stream appended to a caller's buffer. Whole blocks are coded straight
+// from the caller's data; only a tail shorter than a block is kept until the next call. The coder state and the
+// buffers are kept between streams, so a long-lived compressor stops allocating once it has warmed up.
+class Compressor {
+public:
+    explicit Compressor(const CodingOptions &options = CodingOptions(), size_t block_size = DEFAULT_BLOCK_SIZE)
+        : huffman_code_(options), block_size_(std::min(std::max(block_size, MIN_BLOCK_SIZE), MAX_BLOCK_SIZE)) {
+    }
+    void Write(const unsigned char *data, size_t size, BufferWriter &output) {
+        if (not tail_.empty()) {
+            size_t count = std::min(size, block_size_ - tail_.size());
+            tail_.insert(tail_.end(), data, data + count);
+            data += count;
+            size -= count;
+            if (tail_.size() < block_size_) {
+                return;
+            }
+            Flush(output);
+        }
+        for (; size >= block_size_; data += block_size_, size -= block_size_) {
+            WriteBlock(output, data, block_size_, huffman_code_);
+        }
+        tail_.assign(data, data + size);
+    }
+    // Codes the kept tail as a block of its own, so everything written so far can be decompressed.
+    void Flush(BufferWriter &output) {
+        if (not tail_.empty()) {
+            WriteBlock(output, tail_.data(), tail_.size(), huffman_code_);
+            tail_.clear();
+        }
+    }
+    // Ends the stream; the next Write starts a new one.
+    void Finish(BufferWriter &output) {
+        Flush(output);
+        WriteInteger(output, 0, 4);
+    }
+    void Compress(const unsigned char *data, size_t size, BufferWriter &output) {
+        Write(data, size, output);
+        Finish(output);
+    }
+
+private:
+    HuffmanCoding huffman_code_;
+    size_t block_size_;
+    std::vector<unsigned char> tail_;
+};
+
+// Decompresses a block stream fed in pieces of any size. A block that arrives whole is decoded straight from the
+// caller's data into the output buffer; only a block split between calls is gathered first. A stream compressed
+// with CodingOptions::dictionary needs the same dictionary here.
+class Decompressor {
+public:
+    explicit Decompressor(const Dictionary *dictionary = nullptr) {
+        SetDictionary(dictionary);
+    }
+    void SetDictionary(const Dictionary *dictionary) {
+        huffman_code_.SetDictionary(dictionary);
+    }
+    // Appends the decoded bytes to output and returns how much of data was used, which is less than size only
+    // when the stream ends inside data.
+    size_t Write(const unsigned char *data, size_t size, BufferWriter &output) {
+        const unsigned char *begin = data;
+        while (size > 0 and not is_finished_) {
+            if (pending_.empty()) {
+                size_t record_size = RecordSize(data, size);
+                if (record_size <= size) {
+                    DecodeRecord(data, output);
+                    data += record_size;
+                    size -= record_size;
+                    continue;
+                }
+            }
+            size_t record_size = RecordSize(pending_.data(), pending_.size());
+            while (pending_.size() < record_size and size > 0) {
+                size_t count = std::min(size, record_size - pending_.size());
+                pending_.insert(pending_.end(), data, data + count);
+                data += count;
+                size -= count;
+                record_size = RecordSize(pending_.data(), pending_.size());
+            }
+            if (pending_.size() == record_size) {
+                DecodeRecord(pending_.data(), output);
+                pending_.clear();
+            }
+        }
+        return data - begin;
+    }
+    bool IsFinished() const {
+        return is_finished_;
+    }
+    // Checks that the stream has ended and gets ready for the next one.
+    void Finish() {
+        if (not is_finished_) {
+            throw ArchiveException("Unexpected end of stream");
+        }
+        is_finished_ = false;
+    }
+    void Decompress(const unsigned char *data, size_t size, BufferWriter &output) {
+        if (Write(data, size, output) != size) {
+            throw ArchiveException("Unexpected data after the end of stream");
+        }
+        Finish();
+    }
+
+private:
+    // Size of the block record at data, or of the part of its header still missing when size does not cover it.
+    static size_t RecordSize(const unsigned char *data, size_t size) {
+        if (size < 4) {
+            return 4;
+        }
+        size_t raw_size = LoadInteger(data, 4);
+        if (raw_size == 0) {
+            return 4;
+        }
+        if (size < BLOCK_HEADER_SIZE) {
+            return BLOCK_HEADER_SIZE;
+        }
+        size_t payload_size = LoadInteger(data + 4, 4);
+        CheckBlockSizes(raw_size, payload_size);
+        return BLOCK_HEADER_SIZE + payload_size;
+    }
+    void DecodeRecord(const unsigned char *record, BufferWriter &output) {
+        size_t raw_size = LoadInteger(record, 4);
+        if (raw_size == 0) {
+            is_finished_ = true;
+            return;
+        }
+        unsigned char *target = reinterpret_cast<unsigned char *>(output.Reserve(raw_size));
+        huffman_code_.DecodeBlock(record + BLOCK_HEADER_SIZE, LoadInteger(record + 4, 4), target, raw_size);
+        output.Commit(raw_size);
+    }
+
+    HuffmanCoding huffman_code_;
+    std::vector<unsigned char> pending_;
+    bool is_finished_ = false;
+};
+
+// One-shot calls for callers that do not keep a codec around.
+inline BufferWriter Compress(const unsigned char *data, size_t size, const CodingOptions &options = CodingOptions()) {
+    BufferWriter output;
+    Compressor(options).Compress(data, size, output);
+    return output;
+}
+
+inline BufferWriter Decompress(const unsigned char *data, size_t size, const Dictionary *dictionary = nullptr) {
+    BufferWriter output;
+    Decompressor(dictionary).Decompress(data, size, output);
+    return output;
+}
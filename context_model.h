@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "huffman_tree.h"
+
+const int32_t CONTEXTS_COUNT = 256;
+const int32_t MAX_CONTEXT_GROUPS = 16;
+
+// Order-1 model of a block: every byte is counted under the byte before it (0 for the first byte), and the 256
+// contexts are clustered into a few groups that share one code. Clustering is a k-means over the context histograms
+// with the cost of coding a context by a group's statistics as the distance, seeded with the busiest contexts.
+class ContextModel {
+public:
+    ContextModel() {
+    }
+    void Count(const unsigned char *data, size_t size) {
+        context_frequency_.assign(CONTEXTS_COUNT * CONTEXTS_COUNT, 0);
+        uint32_t *frequency = context_frequency_.data();
+        uint32_t context = 0;
+        for (size_t i = 0; i < size; ++i) {
+            ++frequency[(context << 8) | data[i]];
+            context = data[i];
+        }
+    }
+    // Returns the number of groups, at most max_groups_count and at least 1 unless the block is empty.
+    int32_t Cluster(int32_t max_groups_count) {
+        std::vector<int32_t> contexts;
+        std::array<uint64_t, CONTEXTS_COUNT> context_total{};
+        symbol_counts_.clear();
+        for (int32_t context = 0; context < CONTEXTS_COUNT; ++context) {
+            symbols_begin_[context] = symbol_counts_.size();
+            for (int32_t symbol = 0; symbol < CONTEXTS_COUNT; ++symbol) {
+                uint32_t count = context_frequency_[(context << 8) | symbol];
+                if (count > 0) {
+                    symbol_counts_.push_back({symbol, count});
+                    context_total[context] += count;
+                }
+            }
+            if (context_total[context] > 0) {
+                contexts.push_back(context);
+            }
+        }
+        symbols_begin_[CONTEXTS_COUNT] = symbol_counts_.size();
+        std::stable_sort(contexts.begin(), contexts.end(), [&context_total](int32_t first, int32_t second) {
+            return context_total[first] > context_total[second];
+        });
+
+        groups_count_ = std::min(max_groups_count, static_cast<int32_t>(contexts.size()));
+        group_of_.fill(0);
+        std::vector<int32_t> seeds(contexts.begin(), contexts.begin() + groups_count_);
+        for (int32_t i = 0; i < groups_count_; ++i) {
+            group_of_[seeds[i]] = static_cast<uint8_t>(i);
+        }
+        SumGroups(seeds);
+        for (int32_t iteration = 0; iteration < CLUSTER_ITERATIONS; ++iteration) {
+            if (groups_count_ > 1) {
+                Assign(contexts);
+            }
+            SumGroups(contexts);
+        }
+
+        // Unused contexts follow the context before them, which keeps the runs of the stored map long.
+        for (int32_t context = 1; context < CONTEXTS_COUNT; ++context) {
+            if (context_total[context] == 0) {
+                group_of_[context] = group_of_[context - 1];
+            }
+        }
+        return groups_count_;
+    }
+    int32_t GetGroupsCount() const {
+        return groups_count_;
+    }
+    const std::array<uint8_t, CONTEXTS_COUNT> &GetGroups() const {
+        return group_of_;
+    }
+    const SymbolFrequencies &GetFrequency(int32_t group) const {
+        return group_frequency_[group];
+    }
+
+private:
+    static const int32_t CLUSTER_ITERATIONS = 4;
+
+    struct SymbolCount {
+        int32_t symbol;
+        uint32_t count;
+    };
+
+    // Recomputes the group histograms and drops groups that lost all their contexts.
+    void SumGroups(const std::vector<int32_t> &contexts) {
+        std::array<int32_t, MAX_CONTEXT_GROUPS> renumbered;
+        renumbered.fill(-1);
+        int32_t groups_count = 0;
+        for (int32_t context : contexts) {
+            int32_t &group = renumbered[group_of_[context]];
+            if (group < 0) {
+                group = groups_count++;
+            }
+        }
+        groups_count_ = groups_count;
+        group_frequency_.assign(groups_count_, SymbolFrequencies{});
+        for (int32_t context : contexts) {
+            group_of_[context] = static_cast<uint8_t>(renumbered[group_of_[context]]);
+            SymbolFrequencies &frequency = group_frequency_[group_of_[context]];
+            for (size_t i = symbols_begin_[context]; i < symbols_begin_[context + 1]; ++i) {
+                frequency[symbol_counts_[i].symbol] += symbol_counts_[i].count;
+            }
+        }
+    }
+    // Moves every context to the group that codes it in the fewest bits.
+    void Assign(const std::vector<int32_t> &contexts) {
+        std::vector<std::array<float, CONTEXTS_COUNT>> cost(groups_count_);
+        for (int32_t group = 0; group < groups_count_; ++group) {
+            uint64_t total = 0;
+            for (int32_t symbol = 0; symbol < CONTEXTS_COUNT; ++symbol) {
+                total += group_frequency_[group][symbol];
+            }
+            double total_bits = std::log2(total + 0.5 * CONTEXTS_COUNT);
+            for (int32_t symbol = 0; symbol < CONTEXTS_COUNT; ++symbol) {
+                double bits = total_bits - std::log2(group_frequency_[group][symbol] + 0.5);
+                cost[group][symbol] = static_cast<float>(bits);
+            }
+        }
+        for (int32_t context : contexts) {
+            float best_bits = 0;
+            for (int32_t group = 0; group < groups_count_; ++group) {
+                float bits = 0;
+                for (size_t j = symbols_begin_[context]; j < symbols_begin_[context + 1]; ++j) {
+                    bits += symbol_counts_[j].count * cost[group][symbol_counts_[j].symbol];
+                }
+                if (group == 0 or bits < best_bits) {
+                    best_bits = bits;
+                    group_of_[context] = static_cast<uint8_t>(group);
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> context_frequency_;
+    std::vector<SymbolCount> symbol_counts_;
+    std::array<size_t, CONTEXTS_COUNT + 1> symbols_begin_{};
+    std::array<uint8_t, CONTEXTS_COUNT> group_of_{};
+    std::vector<SymbolFrequencies> group_frequency_;
+    int32_t groups_count_ = 0;
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) and not defined(ARCHIVER_NO_HARDWARE_CRC)
+#include <nmmintrin.h>
+#define ARCHIVER_CRC32C_SSE42
+#elif defined(__aarch64__) and defined(__ARM_FEATURE_CRC32) and not defined(ARCHIVER_NO_HARDWARE_CRC)
+#include <arm_acle.h>
+#define ARCHIVER_CRC32C_ARM
+#endif
+
+const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+// Bytes of each of the three lanes the hardware CRC runs side by side, so the next instruction need not wait for the
+// result of the one before.
+const size_t CRC32C_LANE_SIZE = 4096;
+
+// Tables for slicing by 8: entry k of a byte is its CRC followed by k zero bytes.
+class Crc32cTable {
+public:
+    Crc32cTable() {
+        for (uint32_t byte = 0; byte < 256; ++byte) {
+            uint32_t crc = byte;
+            for (int32_t bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+            }
+            tables_[0][byte] = crc;
+        }
+        for (size_t k = 1; k < tables_.size(); ++k) {
+            for (uint32_t byte = 0; byte < 256; ++byte) {
+                tables_[k][byte] = (tables_[k - 1][byte] >> 8) ^ tables_[0][tables_[k - 1][byte] & 0xFF];
+            }
+        }
+    }
+    const std::array<uint32_t, 256> &operator[](size_t index) const {
+        return tables_[index];
+    }
+
+private:
+    std::array<std::array<uint32_t, 256>, 8> tables_;
+};
+
+inline uint32_t Crc32cSoftware(uint32_t crc, const unsigned char *data, size_t size) {
+    static const Crc32cTable table;
+    crc = ~crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        uint32_t low = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24);
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^
+              table[4][low >> 24] ^ table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+    }
+    for (; size > 0; --size) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xFF];
+    }
+    return ~crc;
+}
+
+// Moves a CRC register over a fixed number of zero bytes with four table lookups, which is how the lanes of the
+// hardware CRC are merged.
+class Crc32cShift {
+public:
+    explicit Crc32cShift(size_t zeros_count) {
+        static const Crc32cTable table;
+        std::array<uint32_t, 32> bits;
+        for (int32_t bit = 0; bit < 32; ++bit) {
+            uint32_t crc = 1u << bit;
+            for (size_t i = 0; i < zeros_count; ++i) {
+                crc = (crc >> 8) ^ table[0][crc & 0xFF];
+            }
+            bits[bit] = crc;
+        }
+        for (int32_t k = 0; k < 4; ++k) {
+            for (uint32_t byte = 0; byte < 256; ++byte) {
+                uint32_t crc = 0;
+                for (int32_t bit = 0; bit < 8; ++bit) {
+                    if (byte >> bit & 1) {
+                        crc ^= bits[8 * k + bit];
+                    }
+                }
+                tables_[k][byte] = crc;
+            }
+        }
+    }
+    uint32_t operator()(uint32_t crc) const {
+        return tables_[0][crc & 0xFF] ^ tables_[1][(crc >> 8) & 0xFF] ^ tables_[2][(crc >> 16) & 0xFF] ^
+               tables_[3][crc >> 24];
+    }
+
+private:
+    std::array<std::array<uint32_t, 256>, 4> tables_;
+};
+
+#if defined(ARCHIVER_CRC32C_SSE42)
+inline uint64_t LoadCrcWord(const unsigned char *data) {
+    uint64_t word = 0;
+    std::memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+__attribute__((target("sse4.2"))) inline uint32_t Crc32cSse42(uint32_t crc, const unsigned char *data, size_t size) {
+    static const Crc32cShift shift(CRC32C_LANE_SIZE);
+    uint64_t first = ~crc;
+    for (; size >= 3 * CRC32C_LANE_SIZE; size -= 3 * CRC32C_LANE_SIZE, data += 3 * CRC32C_LANE_SIZE) {
+        uint64_t second = 0;
+        uint64_t third = 0;
+        for (size_t i = 0; i < CRC32C_LANE_SIZE; i += 8) {
+            first = _mm_crc32_u64(first, LoadCrcWord(data + i));
+            second = _mm_crc32_u64(second, LoadCrcWord(data + CRC32C_LANE_SIZE + i));
+            third = _mm_crc32_u64(third, LoadCrcWord(data + 2 * CRC32C_LANE_SIZE + i));
+        }
+        first = shift(shift(static_cast<uint32_t>(first)) ^ static_cast<uint32_t>(second)) ^ third;
+    }
+    for (; size >= 8; size -= 8, data += 8) {
+        first = _mm_crc32_u64(first, LoadCrcWord(data));
+    }
+    uint32_t crc_state = static_cast<uint32_t>(first);
+    for (; size > 0; --size) {
+        crc_state = _mm_crc32_u8(crc_state, *data++);
+    }
+    return ~crc_state;
+}
+#elif defined(ARCHIVER_CRC32C_ARM)
+inline uint32_t Crc32cArm(uint32_t crc, const unsigned char *data, size_t size) {
+    crc = ~crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        uint64_t word = 0;
+        std::memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; size > 0; --size) {
+        crc = __crc32cb(crc, *data++);
+    }
+    return ~crc;
+}
+#endif
+
+// CRC-32C (Castagnoli) of data, continuing from the CRC of the preceding bytes (0 for none). Uses the CRC32
+// instruction where the CPU has one, and slicing by 8 elsewhere; -DARCHIVER_NO_HARDWARE_CRC forces the latter.
+inline uint32_t Crc32c(uint32_t crc, const unsigned char *data, size_t size) {
+#if defined(ARCHIVER_CRC32C_SSE42)
+    static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+    if (has_sse42) {
+        return Crc32cSse42(crc, data, size);
+    }
+#elif defined(ARCHIVER_CRC32C_ARM)
+    return Crc32cArm(crc, data, size);
+#endif
+    return Crc32cSoftware(crc, data, size);
+}
+
+// Product of two polynomials modulo the CRC-32C polynomial, both with their bits in the reflected order of the CRC
+// register, where the top bit is x^0.
+inline uint32_t Crc32cMultiply(uint32_t first, uint32_t second) {
+    uint32_t product = 0;
+    for (uint32_t bit = 1u << 31; bit != 0; bit >>= 1) {
+        if (first & bit) {
+            product ^= second;
+        }
+        second = (second >> 1) ^ ((second & 1) ? CRC32C_POLYNOMIAL : 0);
+    }
+    return product;
+}
+
+// x^(8 * 2^k) modulo the CRC-32C polynomial for every k: multiplying a CRC by one of them moves it over 2^k zero bytes.
+class Crc32cPowers {
+public:
+    Crc32cPowers() {
+        powers_[0] = 1u << (31 - 8);
+        for (size_t k = 1; k < powers_.size(); ++k) {
+            powers_[k] = Crc32cMultiply(powers_[k - 1], powers_[k - 1]);
+        }
+    }
+    uint32_t operator[](size_t index) const {
+        return powers_[index];
+    }
+
+private:
+    std::array<uint32_t, 64> powers_;
+};
+
+// CRC of the concatenation of two byte strings from their CRCs and the length of the second one, so blocks can be
+// checksummed independently and merged in order. Costs one multiplication per set bit of the length.
+inline uint32_t Crc32cCombine(uint32_t first_crc, uint32_t second_crc, uint64_t second_size) {
+    static const Crc32cPowers powers;
+    for (size_t k = 0; second_size != 0; ++k, second_size >>= 1) {
+        if (second_size & 1) {
+            first_crc = Crc32cMultiply(powers[k], first_crc);
+        }
+    }
+    return first_crc ^ second_crc;
+}
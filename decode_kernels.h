@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "bit_handler.h"
+#include "decode_table.h"
+
+// Huffman decoding loops built at compile time for one table shape: the number of interleaved streams and a bound
+// on the code length, which fixes how many codes one 8-byte load holds, so the loops over symbols and streams unroll
+// and every stream keeps its bit position in a register. A table whose codes all fit the lookup never looks at its
+// second level. Every shape is also built for CPUs with BMI2, whose shifts by a variable count take one instruction,
+// and DecodeKernelFor picks the one for a table at run time.
+// The lookup width is not a parameter of the kernels: every table they read is built PRIMARY_LOOKUP_BITS (11) wide,
+// which measured the same as 12 and better than 10, so other widths would only multiply the instantiations. BMI2 is
+// the only instruction set variant, since the loops are scalar and AVX2 code generation made them slower.
+
+// Bits one load is guaranteed to hold after the up to 7 bits of its first byte already consumed.
+const int32_t KERNEL_LOADED_BITS = 57;
+
+using DecodeKernel = void (*)(const DecodeEntry *table, MemoryReader *bit_readers, BitString *bit_strings,
+                              unsigned char *output, size_t *positions, size_t count);
+
+inline uint64_t LoadBigEndian(const unsigned char *data) {
+    uint64_t word = 0;
+    std::memcpy(&word, data, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+// Decodes count symbols into output[positions[i]...] from every stream i while all streams hold a whole load,
+// advancing positions, and leaves the rest to the caller with the readers and bit strings where decoding stopped.
+template <int32_t STREAMS, int32_t MAX_LENGTH>
+__attribute__((always_inline)) inline void DecodeLoads(const DecodeEntry *table, MemoryReader *bit_readers,
+                                                       BitString *bit_strings, unsigned char *output,
+                                                       size_t *positions, size_t count) {
+    constexpr int32_t SYMBOLS_PER_LOAD = KERNEL_LOADED_BITS / MAX_LENGTH;
+    // Local copies of everything the loop updates, since a store of a byte could alias anything behind a pointer.
+    const unsigned char *data[STREAMS];
+    size_t last_loads[STREAMS];
+    uint64_t consumed[STREAMS];
+    unsigned char *outputs[STREAMS];
+    for (int32_t i = 0; i < STREAMS; ++i) {
+        if (bit_readers[i].Size() < sizeof(uint64_t)) {
+            return;
+        }
+    }
+    for (int32_t i = 0; i < STREAMS; ++i) {
+        outputs[i] = output + positions[i];
+        data[i] = bit_readers[i].Data();
+        last_loads[i] = bit_readers[i].Size() - sizeof(uint64_t);
+        consumed[i] = 8 * static_cast<uint64_t>(bit_readers[i].Position()) - bit_strings[i].GetLength();
+    }
+    for (size_t loads = count / SYMBOLS_PER_LOAD; loads > 0; --loads) {
+        bool is_ready = true;
+        for (int32_t i = 0; i < STREAMS; ++i) {
+            is_ready &= consumed[i] / 8 <= last_loads[i];
+        }
+        if (not is_ready) {
+            break;
+        }
+        uint64_t bits[STREAMS];
+        for (int32_t i = 0; i < STREAMS; ++i) {
+            bits[i] = LoadBigEndian(data[i] + consumed[i] / 8) << (consumed[i] % 8);
+        }
+        for (int32_t j = 0; j < SYMBOLS_PER_LOAD; ++j) {
+            for (int32_t i = 0; i < STREAMS; ++i) {
+                const DecodeEntry *entry = &table[bits[i] >> (64 - PRIMARY_LOOKUP_BITS)];
+                if constexpr (MAX_LENGTH > PRIMARY_LOOKUP_BITS) {
+                    if (entry->sub_bits > 0) {
+                        entry = &table[entry->value + ((bits[i] << PRIMARY_LOOKUP_BITS) >> (64 - entry->sub_bits))];
+                    }
+                }
+                bits[i] <<= entry->length;
+                consumed[i] += entry->length;
+                *outputs[i]++ = static_cast<unsigned char>(entry->value);
+            }
+        }
+    }
+    for (int32_t i = 0; i < STREAMS; ++i) {
+        positions[i] = outputs[i] - output;
+        size_t byte = consumed[i] / 8;
+        int32_t used_bits = consumed[i] % 8;
+        if (used_bits == 0) {
+            bit_readers[i].Seek(byte);
+            bit_strings[i] = BitString();
+        } else {
+            int32_t left_bits = 8 - used_bits;
+            bit_readers[i].Seek(byte + 1);
+            bit_strings[i] = BitString(left_bits, data[i][byte] & ((1 << left_bits) - 1));
+        }
+    }
+}
+
+template <int32_t STREAMS, int32_t MAX_LENGTH>
+void DecodeLoadsBaseline(const DecodeEntry *table, MemoryReader *bit_readers, BitString *bit_strings,
+                         unsigned char *output, size_t *positions, size_t count) {
+    DecodeLoads<STREAMS, MAX_LENGTH>(table, bit_readers, bit_strings, output, positions, count);
+}
+
+#if defined(__x86_64__)
+template <int32_t STREAMS, int32_t MAX_LENGTH>
+__attribute__((target("bmi,bmi2"))) void DecodeLoadsBmi2(const DecodeEntry *table, MemoryReader *bit_readers,
+                                                          BitString *bit_strings, unsigned char *output,
+                                                          size_t *positions, size_t count) {
+    DecodeLoads<STREAMS, MAX_LENGTH>(table, bit_readers, bit_strings, output, positions, count);
+}
+#endif
+
+template <int32_t STREAMS, int32_t MAX_LENGTH>
+DecodeKernel SelectDecodeKernel() {
+#if defined(__x86_64__)
+    static const bool has_bmi2 = __builtin_cpu_supports("bmi2");
+    if (has_bmi2) {
+        return DecodeLoadsBmi2<STREAMS, MAX_LENGTH>;
+    }
+#endif
+    return DecodeLoadsBaseline<STREAMS, MAX_LENGTH>;
+}
+
+// The kernel for a table whose longest code has max_length bits: the smallest bound that still holds it, so one
+// load decodes as many symbols as possible.
+template <int32_t STREAMS>
+DecodeKernel DecodeKernelFor(int32_t max_length) {
+    static const DecodeKernel kernels[] = {
+        SelectDecodeKernel<STREAMS, PRIMARY_LOOKUP_BITS>(), SelectDecodeKernel<STREAMS, 14>(),
+        SelectDecodeKernel<STREAMS, 19>(), SelectDecodeKernel<STREAMS, 28>(), SelectDecodeKernel<STREAMS, 57>()};
+    if (max_length <= PRIMARY_LOOKUP_BITS) {
+        return kernels[0];
+    }
+    if (max_length <= 14) {
+        return kernels[1];
+    }
+    if (max_length <= 19) {
+        return kernels[2];
+    }
+    return max_length <= 28 ? kernels[3] : kernels[4];
+}
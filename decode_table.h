@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "bit_handler.h"
+#include "package_merge.h"
+
+const int32_t PRIMARY_LOOKUP_BITS = 11;
+
+// False when the code lengths (1 to MAX_CODE_LENGTH) overflow the code space; such codes would index past the table.
+inline bool IsPrefixCode(const std::vector<std::pair<int16_t, int16_t>> &lengths_and_symbols) {
+    uint64_t code_space = 0;
+    for (const auto &[length, symbol] : lengths_and_symbols) {
+        code_space += static_cast<uint64_t>(1) << (MAX_CODE_LENGTH - length);
+    }
+    return code_space <= static_cast<uint64_t>(1) << MAX_CODE_LENGTH;
+}
+
+struct DecodeEntry {
+    int32_t value = 0;
+    int16_t length = 0;
+    int16_t sub_bits = 0;
+};
+
+// Two-level lookup table over canonical codes: the first PRIMARY_LOOKUP_BITS bits of the stream select either
+// a symbol or a second-level table that resolves the remaining bits of a long code. A table of short codes looks up
+// only as many bits as its longest code, unless it is built full width for the decode kernels, which always look up
+// PRIMARY_LOOKUP_BITS bits.
+class DecodeTable {
+public:
+    DecodeTable() {
+    }
+    void Build(const std::vector<std::pair<int16_t, int16_t>> &lengths_and_symbols, bool is_full_width = false) {
+        max_length_ = lengths_and_symbols.empty() ? 0 : lengths_and_symbols.back().first;
+        lookup_bits_ = PRIMARY_LOOKUP_BITS;
+        if (not is_full_width) {
+            lookup_bits_ = std::min(lookup_bits_, static_cast<int32_t>(max_length_));
+        }
+        table_.assign(static_cast<size_t>(1) << lookup_bits_, DecodeEntry());
+
+        std::vector<int64_t> codes(lengths_and_symbols.size());
+        int64_t current_code = 0;
+        int32_t current_length = 0;
+        for (size_t i = 0; i < lengths_and_symbols.size(); ++i) {
+            current_code <<= lengths_and_symbols[i].first - current_length;
+            current_length = lengths_and_symbols[i].first;
+            codes[i] = current_code;
+            ++current_code;
+        }
+
+        std::vector<int16_t> prefix_sub_bits(table_.size(), 0);
+        for (size_t i = 0; i < lengths_and_symbols.size(); ++i) {
+            int32_t length = lengths_and_symbols[i].first;
+            if (length > lookup_bits_) {
+                int64_t prefix = codes[i] >> (length - lookup_bits_);
+                prefix_sub_bits[prefix] =
+                    std::max(prefix_sub_bits[prefix], static_cast<int16_t>(length - lookup_bits_));
+            }
+        }
+        for (size_t prefix = 0; prefix < prefix_sub_bits.size(); ++prefix) {
+            if (prefix_sub_bits[prefix] > 0) {
+                table_[prefix].value = static_cast<int32_t>(table_.size());
+                table_[prefix].length = static_cast<int16_t>(lookup_bits_);
+                table_[prefix].sub_bits = prefix_sub_bits[prefix];
+                table_.resize(table_.size() + (static_cast<size_t>(1) << prefix_sub_bits[prefix]));
+            }
+        }
+
+        for (size_t i = 0; i < lengths_and_symbols.size(); ++i) {
+            const auto &[length, symbol] = lengths_and_symbols[i];
+            DecodeEntry entry;
+            entry.value = symbol;
+            entry.length = length;
+            size_t first = 0;
+            size_t count = 0;
+            if (length <= lookup_bits_) {
+                first = static_cast<size_t>(codes[i]) << (lookup_bits_ - length);
+                count = static_cast<size_t>(1) << (lookup_bits_ - length);
+            } else {
+                int32_t tail_bits = length - lookup_bits_;
+                const DecodeEntry &link = table_[codes[i] >> tail_bits];
+                size_t tail = static_cast<size_t>(codes[i] & ((static_cast<int64_t>(1) << tail_bits) - 1));
+                first = link.value + (tail << (link.sub_bits - tail_bits));
+                count = static_cast<size_t>(1) << (link.sub_bits - tail_bits);
+            }
+            std::fill(table_.begin() + first, table_.begin() + first + count, entry);
+        }
+    }
+    int16_t GetMaxLength() const {
+        return max_length_;
+    }
+    int32_t GetLookupBits() const {
+        return lookup_bits_;
+    }
+    const DecodeEntry *GetEntries() const {
+        return table_.data();
+    }
+    // The caller keeps at least GetMaxLength() bits in bit_string unless the input is exhausted; a code cut short by
+    // the end of the input throws.
+    int16_t Decode(BitString &bit_string) const {
+        const DecodeEntry *entry = &table_[bit_string.PeekBits(lookup_bits_)];
+        if (entry->sub_bits > 0) {
+            uint64_t bits = bit_string.PeekBits(lookup_bits_ + entry->sub_bits);
+            entry = &table_[entry->value + (bits & ((static_cast<uint64_t>(1) << entry->sub_bits) - 1))];
+        }
+        bit_string.SkipBits(entry->length);
+        return static_cast<int16_t>(entry->value);
+    }
+
+private:
+    std::vector<DecodeEntry> table_;
+    int32_t lookup_bits_ = 0;
+    int16_t max_length_ = 0;
+};
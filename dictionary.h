@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "crc32c.h"
+#include "decode_table.h"
+#include "huffman_tree.h"
+
+const int32_t DICTIONARY_SYMBOLS_COUNT = 256;
+
+// Canonical code over all 256 byte values shared by many blocks, so none of them carries or builds a table of its
+// own. The id is derived from the code lengths, which are all a dictionary consists of.
+class Dictionary {
+public:
+    explicit Dictionary(const SymbolLengths &code_length) : code_length_(code_length) {
+        SymbolList symbols;
+        for (int32_t symbol = 0; symbol < DICTIONARY_SYMBOLS_COUNT; ++symbol) {
+            symbols[symbol] = static_cast<int16_t>(symbol);
+        }
+        SetCanonicalCodes(code_length_, symbols, DICTIONARY_SYMBOLS_COUNT, code_);
+        std::vector<std::pair<int16_t, int16_t>> lengths_and_symbols;
+        unsigned char lengths[DICTIONARY_SYMBOLS_COUNT];
+        for (int32_t i = 0; i < DICTIONARY_SYMBOLS_COUNT; ++i) {
+            lengths_and_symbols.emplace_back(code_length_[symbols[i]], symbols[i]);
+            lengths[i] = static_cast<unsigned char>(code_length_[i]);
+        }
+        table_.Build(lengths_and_symbols, true);
+        id_ = std::max<uint32_t>(Crc32c(0, lengths, DICTIONARY_SYMBOLS_COUNT), 1);
+    }
+    // Builds the code for bytes with the given counts; bytes never seen still get a code, so any data can use it.
+    static Dictionary Train(const SymbolFrequencies &frequency, int16_t max_code_length) {
+        SymbolFrequencies smoothed{};
+        for (int32_t symbol = 0; symbol < DICTIONARY_SYMBOLS_COUNT; ++symbol) {
+            smoothed[symbol] = frequency[symbol] + 1;
+        }
+        SymbolLengths code_length{};
+        SymbolList symbols;
+        HuffmanTree().Build(smoothed, DICTIONARY_SYMBOLS_COUNT, max_code_length, code_length, symbols);
+        return Dictionary(code_length);
+    }
+    uint32_t GetId() const {
+        return id_;
+    }
+    const SymbolLengths &GetCodeLengths() const {
+        return code_length_;
+    }
+    const SymbolCodes &GetCodes() const {
+        return code_;
+    }
+    const DecodeTable &GetTable() const {
+        return table_;
+    }
+
+private:
+    SymbolLengths code_length_;
+    SymbolCodes code_{};
+    DecodeTable table_;
+    uint32_t id_ = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Fingerprint for finding repeated files and blocks, cheap enough to run over all the input. It only picks the
+// candidates, which are then compared byte for byte, and is never stored in the archive.
+
+const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t RotateLeft(uint64_t value, int32_t count) {
+    return (value << count) | (value >> (64 - count));
+}
+
+inline uint64_t LoadWord(const unsigned char *data) {
+    uint64_t word = 0;
+    std::memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+inline uint64_t XxhRound(uint64_t accumulator, uint64_t input) {
+    return RotateLeft(accumulator + input * XXH_PRIME64_2, 31) * XXH_PRIME64_1;
+}
+
+inline uint64_t XxhMerge(uint64_t hash, uint64_t accumulator) {
+    return (hash ^ XxhRound(0, accumulator)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// XXH64 of data in the byte order of the host, which is enough for hashes that never leave the process.
+inline uint64_t FastHash(const unsigned char *data, size_t size, uint64_t seed = 0) {
+    const unsigned char *end = data + size;
+    uint64_t hash = seed + XXH_PRIME64_5;
+    if (size >= 32) {
+        uint64_t lanes[4] = {seed + XXH_PRIME64_1 + XXH_PRIME64_2, seed + XXH_PRIME64_2, seed, seed - XXH_PRIME64_1};
+        for (; end - data >= 32; data += 32) {
+            for (int32_t lane = 0; lane < 4; ++lane) {
+                lanes[lane] = XxhRound(lanes[lane], LoadWord(data + 8 * lane));
+            }
+        }
+        hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+        for (uint64_t lane : lanes) {
+            hash = XxhMerge(hash, lane);
+        }
+    }
+    hash += size;
+    for (; end - data >= 8; data += 8) {
+        hash = RotateLeft(hash ^ XxhRound(0, LoadWord(data)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (end - data >= 4) {
+        uint32_t word = 0;
+        std::memcpy(&word, data, sizeof(word));
+        hash = RotateLeft(hash ^ (word * XXH_PRIME64_1), 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        data += 4;
+    }
+    for (; data < end; ++data) {
+        hash = RotateLeft(hash ^ (*data * XXH_PRIME64_5), 11) * XXH_PRIME64_1;
+    }
+    hash = (hash ^ (hash >> 33)) * XXH_PRIME64_2;
+    hash = (hash ^ (hash >> 29)) * XXH_PRIME64_3;
+    return hash ^ (hash >> 32);
+}
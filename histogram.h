@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "huffman_tree.h"
+
+const int32_t HISTOGRAM_TABLES = 8;
+
+// Adds the byte counts of data to frequency[0..255]. Every byte of an 8-byte load goes to its own counter table, so
+// runs of one byte value do not serialize on a single counter's store-to-load dependency.
+inline void CountBytes(const unsigned char *data, size_t size, SymbolFrequencies &frequency) {
+    static const size_t MAX_CHUNK_SIZE = static_cast<size_t>(1) << 32;
+    while (size > 0) {
+        size_t chunk_size = size < MAX_CHUNK_SIZE ? size : MAX_CHUNK_SIZE;
+        uint32_t counts[HISTOGRAM_TABLES][256] = {};
+        const unsigned char *position = data;
+        const unsigned char *end = data + chunk_size;
+        while (end - position >= 8) {
+            uint64_t word;
+            std::memcpy(&word, position, 8);
+            position += 8;
+            ++counts[0][word & 0xFF];
+            ++counts[1][(word >> 8) & 0xFF];
+            ++counts[2][(word >> 16) & 0xFF];
+            ++counts[3][(word >> 24) & 0xFF];
+            ++counts[4][(word >> 32) & 0xFF];
+            ++counts[5][(word >> 40) & 0xFF];
+            ++counts[6][(word >> 48) & 0xFF];
+            ++counts[7][word >> 56];
+        }
+        while (position != end) {
+            ++counts[0][*position++];
+        }
+        for (int32_t symbol = 0; symbol < 256; ++symbol) {
+            uint64_t sum = 0;
+            for (int32_t table = 0; table < HISTOGRAM_TABLES; ++table) {
+                sum += counts[table][symbol];
+            }
+            frequency[symbol] += sum;
+        }
+        data += chunk_size;
+        size -= chunk_size;
+    }
+}
+
+// Number of runs of equal bytes in data, one more than the number of neighbours that differ.
+inline size_t CountRuns(const unsigned char *data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    size_t changes = 0;
+    for (size_t i = 1; i < size; ++i) {
+        changes += data[i] != data[i - 1];
+    }
+    return changes + 1;
+}
+
+// Order-0 entropy of a histogram in bits per byte.
+inline double EstimateEntropy(const SymbolFrequencies &frequency, size_t size) {
+    double entropy = 0;
+    for (int32_t symbol = 0; symbol < 256; ++symbol) {
+        if (frequency[symbol] > 0) {
+            entropy += frequency[symbol] * std::log2(static_cast<double>(size) / frequency[symbol]);
+        }
+    }
+    return size > 0 ? entropy / size : 0;
+}
@@ -1,112 +1,763 @@
 #pragma once
 
 #include <algorithm>
-#include <bitset>
-#include <tuple>
-#include <unordered_map>
+#include <array>
+#include <string>
 #include <vector>
 
 #include "bit_handler.h"
-#include "trie.h"
-#include "priority_queue.h"
+#include "context_model.h"
+#include "decode_kernels.h"
+#include "decode_table.h"
+#include "dictionary.h"
+#include "histogram.h"
+#include "huffman_tree.h"
+#include "lz77.h"
+#include "stats.h"
 
-const int16_t FILENAME_END = 256;
-const int16_t ONE_MORE_FILE = 257;
-const int16_t ARCHIVE_END = 258;
-const int32_t BIT = 1;
 const int32_t BYTE = 8;
 const int32_t ARCHIVED_BYTE = 9;
+const int32_t ALPHABET_SIZE = 256;
 
-template <typename in_stream, typename out_stream>
+const int32_t MAX_STREAMS_COUNT = 8;
+
+const uint8_t STORED_BLOCK = 0;
+const uint8_t HUFFMAN_BLOCK = 1;
+const uint8_t RUN_LENGTH_BLOCK = 2;
+const uint8_t LZ_BLOCK = 3;
+const uint8_t CONTEXT_BLOCK = 4;
+const uint8_t DICTIONARY_BLOCK = 5;
+// Blocks whose order-0 entropy reaches this many bits per byte are stored without trying the other modes, unless
+// LZ is on and long matches cover at least 1 / LZ_PROBE_SHARE of them.
+const double STORED_ENTROPY = 7.9;
+const size_t LZ_PROBE_SHARE = 64;
+
+struct CodingOptions {
+    int16_t max_code_length = MAX_CODE_LENGTH;
+    int32_t streams_count = 1;
+    // 0 turns the LZ77 front end off, 1 to MAX_LZ_LEVEL trade speed for longer matches.
+    int32_t lz_level = 0;
+    size_t lz_window = DEFAULT_LZ_WINDOW;
+    // Up to this many order-1 context groups with a code of their own; 0 or 1 keeps a single code per block.
+    int32_t context_groups = 0;
+    // Shared code that replaces the per-block tables when set; it must outlive the coder.
+    const Dictionary *dictionary = nullptr;
+};
+
+// The longest code of a table over the bytes, which picks the encode loop.
+inline int32_t LongestCode(const int16_t *code_length) {
+    return *std::max_element(code_length, code_length + ALPHABET_SIZE);
+}
+
+// Codes one block of bytes at a time. A block payload starts with its mode byte:
+//   STORED_BLOCK: the bytes as they are;
+//   RUN_LENGTH_BLOCK: (byte, run length - 1 as a LEB128 varint)*;
+//   HUFFMAN_BLOCK: 9-bit maximum code length and streams count, the code table of the bytes, then the codes padded
+//   with zeros to a byte boundary;
+//   CONTEXT_BLOCK: 9-bit maximum code length and groups count, the group of every previous byte as runs of
+//   (group, gamma coded run length), a compact code table per group, then the code of every byte in the group of
+//   the byte before it (the first byte follows a zero);
+//   DICTIONARY_BLOCK: the codes of the bytes in the code of a trained Dictionary, padded to a byte boundary;
+//   LZ_BLOCK: 9-bit maximum code length, the code tables of literals and lengths (symbols 0-255 are bytes, 256 and
+//   up are match length codes) and of distance codes, then the tokens: a literal or length code, and for a length its
+//   extra bits, the distance code and its extra bits (see GetValueCode).
+// A code table is a sequence of 9-bit fields: symbols count, symbols sorted by code length, count of codes of every
+// length up to the longest one. A compact code table is the 9-bit symbols count followed by the symbols in ascending
+// order, each as the Elias gamma code of its distance from the previous symbol and of its zigzagged code length
+// change plus one.
+// The mode is picked from the block histogram: near-random blocks are stored right away, otherwise the smallest of
+// the stored size, a bound on the run-length size and the exact Huffman and context sizes wins. With the LZ77 front
+// end on, a block that is not stored right away is LZ coded unless that comes out larger than storing it. With a
+// dictionary no table is built at all: the block is dictionary coded unless storing or run-length coding is smaller.
+// With 4 or 8 streams a Huffman block is cut into that many equal segments, each coded from a byte boundary, and the
+// table is followed by the byte sizes of all streams but the last (u32 each), so a decoder can walk every stream
+// at once and overlap their otherwise serial lookups.
 class HuffmanCoding {
 public:
-    HuffmanCoding() {
-    }
-    void EncodeFile(BitReader<in_stream> &bit_reader, BitWriter<out_stream> &bit_writer, BitString &bit_string,
-                    std::string filename, bool is_file_last) {
-        std::unordered_map<int16_t, size_t> symbol_frequency;
-        std::unordered_map<int16_t, int16_t> code_length;
-        std::vector<TrieNodePtr> trie_nodes;
-        std::unordered_map<int16_t, int32_t> code;
-
-        CountFrequencies(bit_reader, symbol_frequency);
-        symbol_frequency[FILENAME_END] = 1;
-        symbol_frequency[ONE_MORE_FILE] = 1;
-        symbol_frequency[ARCHIVE_END] = 1;
-        for (size_t i = 0; i < filename.size(); ++i) {
-            ++symbol_frequency[filename[i]];
-        }
-        SetCodeLengths(symbol_frequency, code_length, trie_nodes);
-        SetCodes(code_length, trie_nodes, code);
-
-        bit_reader.Reset();
-        int32_t symbols_count = static_cast<int32_t>(trie_nodes.size());
-        bit_string.Update(bit_writer, ARCHIVED_BYTE, symbols_count);
+    explicit HuffmanCoding(const CodingOptions &options = CodingOptions())
+        : max_code_length_(options.max_code_length),
+          streams_count_(options.streams_count),
+          lz_level_(options.lz_level),
+          context_groups_(std::min(options.context_groups, MAX_CONTEXT_GROUPS)),
+          dictionary_(options.dictionary),
+          match_finder_(std::max(options.lz_level, 1), options.lz_window) {
+    }
+    void SetOptions(const CodingOptions &options) {
+        max_code_length_ = options.max_code_length;
+        streams_count_ = options.streams_count;
+        lz_level_ = options.lz_level;
+        context_groups_ = std::min(options.context_groups, MAX_CONTEXT_GROUPS);
+        dictionary_ = options.dictionary;
+        match_finder_.Configure(std::max(options.lz_level, 1), options.lz_window);
+    }
+    // Dictionary for decoding DICTIONARY_BLOCK payloads.
+    void SetDictionary(const Dictionary *dictionary) {
+        dictionary_ = dictionary;
+    }
+    template <typename Writer>
+    void EncodeBlock(const unsigned char *data, size_t size, Writer &bit_writer) {
+        SymbolFrequencies symbol_frequency;
+        SymbolLengths code_length;
+        SymbolList symbols;
+        SymbolCodes code;
 
-        for (int32_t i = 0; i < symbols_count; ++i) {
-            bit_string.Update(bit_writer, ARCHIVED_BYTE, trie_nodes[i]->GetSymbol());
+        double entropy = 0;
+        size_t runs_count = 0;
+        {
+            StageTimer timer(Stage::HISTOGRAM);
+            CountFrequencies(data, size, symbol_frequency);
+            entropy = EstimateEntropy(symbol_frequency, size);
+            if (entropy < STORED_ENTROPY) {
+                runs_count = CountRuns(data, size);
+            }
+        }
+        Statistics::AddBlock(symbol_frequency);
+        if (entropy >= STORED_ENTROPY) {
+            // Bytes that look random one by one may still repeat, so LZ gets a chance when a probe finds long matches.
+            bool has_repeats = false;
+            if (lz_level_ > 0 and dictionary_ == nullptr) {
+                StageTimer timer(Stage::MATCH);
+                has_repeats = match_finder_.ProbeMatches(data, size) >= size / LZ_PROBE_SHARE;
+            }
+            if (not has_repeats) {
+                EncodeStored(data, size, bit_writer);
+                return;
+            }
+        }
+        size_t run_length_size = 2 * runs_count + size / 128;
+        if (dictionary_ != nullptr) {
+            size_t dictionary_size = 1 + (CodedBits(symbol_frequency, dictionary_->GetCodeLengths()) + BYTE - 1) / BYTE;
+            if (size <= std::min(dictionary_size, run_length_size)) {
+                EncodeStored(data, size, bit_writer);
+            } else if (run_length_size < dictionary_size) {
+                EncodeRunLength(data, size, bit_writer);
+            } else {
+                EncodeDictionary(data, size, bit_writer, symbol_frequency);
+            }
+            return;
         }
-        int32_t max_symbol_code_size = 0;
-        for (const auto &trie_node : trie_nodes) {
-            max_symbol_code_size =
-                std::max(max_symbol_code_size, static_cast<int32_t>(code_length[trie_node->GetSymbol()]));
+        if (lz_level_ > 0) {
+            {
+                StageTimer timer(Stage::MATCH);
+                match_finder_.FindMatches(data, size, tokens_);
+            }
+            if (not EncodeLz(size, bit_writer)) {
+                EncodeStored(data, size, bit_writer);
+            }
+            return;
         }
-        std::vector<int32_t> count_of_length(max_symbol_code_size + 1);
-        for (const auto &[symbol, length] : code_length) {
-            count_of_length[length]++;
+        int32_t symbols_count = 0;
+        {
+            StageTimer timer(Stage::TREE);
+            symbols_count = SetCodeLengths(symbol_frequency, code_length, symbols);
+            SetCanonicalCodes(code_length, symbols, symbols_count, code);
+        }
+        size_t huffman_size = HuffmanSize(symbol_frequency, code_length, symbols_count);
+        size_t context_size = context_groups_ > 1 ? SetContextCodes(data, size) : SIZE_MAX;
+        if (size <= std::min({huffman_size, run_length_size, context_size})) {
+            EncodeStored(data, size, bit_writer);
+        } else if (run_length_size < std::min(huffman_size, context_size)) {
+            EncodeRunLength(data, size, bit_writer);
+        } else if (context_size < huffman_size) {
+            EncodeContext(data, size, bit_writer);
+        } else {
+            Statistics::AddCodeLengths(symbol_frequency, code_length);
+            EncodeHuffman(data, size, bit_writer, code_length, symbols, symbols_count, code);
+        }
+    }
+
+    void DecodeBlock(const unsigned char *payload, size_t payload_size, unsigned char *output, size_t size) {
+        Statistics::Add(Counter::BLOCKS, 1);
+        if (payload_size == 0) {
+            throw ArchiveException("Unexpected end of block");
+        }
+        if (payload[0] == STORED_BLOCK) {
+            if (payload_size - 1 != size) {
+                throw ArchiveException("Corrupted stored block");
+            }
+            StageTimer timer(Stage::DECODE);
+            std::copy(payload + 1, payload + payload_size, output);
+            return;
+        }
+        if (payload[0] == RUN_LENGTH_BLOCK) {
+            StageTimer timer(Stage::DECODE);
+            DecodeRunLength(payload + 1, payload_size - 1, output, size);
+            return;
+        }
+        MemoryReader bit_reader(payload + 1, payload_size - 1);
+        BitString bit_string(0, 0);
+        if (payload[0] == LZ_BLOCK) {
+            DecodeLz(bit_reader, bit_string, output, size);
+            return;
+        }
+        if (payload[0] == DICTIONARY_BLOCK) {
+            if (dictionary_ == nullptr) {
+                throw ArchiveException("Block was coded with a dictionary, but none was given");
+            }
+            StageTimer timer(Stage::DECODE);
+            DecodeStreams<1>(dictionary_->GetTable(), &bit_reader, &bit_string, output, size);
+            return;
+        }
+        if (payload[0] == CONTEXT_BLOCK) {
+            DecodeContext(bit_reader, bit_string, output, size);
+            return;
+        }
+        if (payload[0] != HUFFMAN_BLOCK) {
+            throw ArchiveException("Unknown block mode " + std::to_string(payload[0]));
+        }
+        int32_t streams_count = 0;
+        {
+            StageTimer timer(Stage::DECODE_TABLE);
+            streams_count = ReadHuffmanHeader(bit_reader, bit_string);
+        }
+
+        StageTimer timer(Stage::DECODE);
+        if (streams_count == 1) {
+            DecodeStreams<1>(decode_table_, &bit_reader, &bit_string, output, size);
+            return;
+        }
+        const unsigned char *streams = nullptr;
+        size_t streams_size = bit_reader.ReadChunk(streams);
+        size_t jump_table_size = 4 * static_cast<size_t>(streams_count - 1);
+        if (streams_size < jump_table_size) {
+            throw ArchiveException("Unexpected end of block");
+        }
+        std::array<MemoryReader, MAX_STREAMS_COUNT> stream_readers;
+        const unsigned char *stream = streams + jump_table_size;
+        size_t remaining_size = streams_size - jump_table_size;
+        for (int32_t i = 0; i < streams_count; ++i) {
+            size_t stream_size = remaining_size;
+            if (i + 1 < streams_count) {
+                stream_size = 0;
+                for (int32_t j = 3; j >= 0; --j) {
+                    stream_size = (stream_size << BYTE) | streams[4 * i + j];
+                }
+                if (stream_size > remaining_size) {
+                    throw ArchiveException("Corrupted stream sizes");
+                }
+            }
+            stream_readers[i] = MemoryReader(stream, stream_size);
+            stream += stream_size;
+            remaining_size -= stream_size;
+        }
+        std::array<BitString, MAX_STREAMS_COUNT> bit_strings;
+        if (streams_count == 4) {
+            DecodeStreams<4>(decode_table_, stream_readers.data(), bit_strings.data(), output, size);
+        } else {
+            DecodeStreams<MAX_STREAMS_COUNT>(decode_table_, stream_readers.data(), bit_strings.data(), output,
+                                             size);
+        }
+    }
+
+private:
+    template <typename Writer>
+    void EncodeStored(const unsigned char *data, size_t size, Writer &bit_writer) {
+        StageTimer timer(Stage::ENCODE);
+        Statistics::Add(Counter::STORED_BLOCKS, 1);
+        bit_writer.WriteNext(static_cast<char>(STORED_BLOCK));
+        bit_writer.Write(reinterpret_cast<const char *>(data), size);
+    }
+    template <typename Writer>
+    void EncodeRunLength(const unsigned char *data, size_t size, Writer &bit_writer) {
+        StageTimer timer(Stage::ENCODE);
+        Statistics::Add(Counter::RUN_LENGTH_BLOCKS, 1);
+        bit_writer.WriteNext(static_cast<char>(RUN_LENGTH_BLOCK));
+        size_t position = 0;
+        while (position < size) {
+            size_t end = position + 1;
+            while (end < size and data[end] == data[position]) {
+                ++end;
+            }
+            bit_writer.WriteNext(static_cast<char>(data[position]));
+            for (size_t extra = end - position - 1; true; extra >>= 7) {
+                if (extra < 0x80) {
+                    bit_writer.WriteNext(static_cast<char>(extra));
+                    break;
+                }
+                bit_writer.WriteNext(static_cast<char>(0x80 | (extra & 0x7F)));
+            }
+            position = end;
+        }
+    }
+    template <typename Writer>
+    void EncodeDictionary(const unsigned char *data, size_t size, Writer &bit_writer,
+                          const SymbolFrequencies &symbol_frequency) {
+        StageTimer timer(Stage::ENCODE);
+        Statistics::Add(Counter::DICTIONARY_BLOCKS, 1);
+        Statistics::AddCodeLengths(symbol_frequency, dictionary_->GetCodeLengths());
+        bit_writer.WriteNext(static_cast<char>(DICTIONARY_BLOCK));
+        BitString bit_string(0, 0);
+        const int16_t *code_length = dictionary_->GetCodeLengths().data();
+        bit_string.Encode(bit_writer, data, size, code_length, dictionary_->GetCodes().data(),
+                          LongestCode(code_length));
+        bit_string.Flush(bit_writer);
+    }
+    template <typename Writer>
+    void EncodeHuffman(const unsigned char *data, size_t size, Writer &bit_writer, const SymbolLengths &code_length,
+                       const SymbolList &symbols, int32_t symbols_count, const SymbolCodes &code) {
+        StageTimer timer(Stage::ENCODE);
+        bit_writer.WriteNext(static_cast<char>(HUFFMAN_BLOCK));
+        BitString bit_string(0, 0);
+        bit_string.Update(bit_writer, ARCHIVED_BYTE, max_code_length_);
+        bit_string.Update(bit_writer, ARCHIVED_BYTE, streams_count_);
+        WriteCodeTable(bit_writer, bit_string, code_length, symbols, symbols_count);
+        int32_t max_length = LongestCode(code_length.data());
+        if (streams_count_ == 1) {
+            bit_string.Encode(bit_writer, data, size, code_length.data(), code.data(), max_length);
+            bit_string.Flush(bit_writer);
+            return;
+        }
+        bit_string.Flush(bit_writer);
+        size_t jump_table_position = bit_writer.Size();
+        for (int32_t i = 0; i + 1 < streams_count_; ++i) {
+            bit_string.Update(bit_writer, 32, 0);
+        }
+        size_t segment_size = (size + streams_count_ - 1) / streams_count_;
+        for (int32_t i = 0; i < streams_count_; ++i) {
+            size_t begin = std::min(i * segment_size, size);
+            size_t end = std::min(begin + segment_size, size);
+            size_t stream_position = bit_writer.Size();
+            bit_string.Encode(bit_writer, data + begin, end - begin, code_length.data(), code.data(), max_length);
+            bit_string.Flush(bit_writer);
+            size_t stream_size = bit_writer.Size() - stream_position;
+            if (i + 1 < streams_count_) {
+                for (int32_t j = 0; j < 4; ++j) {
+                    bit_writer.Data()[jump_table_position + 4 * i + j] = static_cast<char>(stream_size >> (BYTE * j));
+                }
+            }
+        }
+    }
+    template <typename Writer>
+    void WriteCodeTable(Writer &bit_writer, BitString &bit_string, const SymbolLengths &code_length,
+                        const SymbolList &symbols, int32_t symbols_count) {
+        bit_string.Update(bit_writer, ARCHIVED_BYTE, symbols_count);
+        if (symbols_count == 0) {
+            return;
+        }
+        for (int32_t i = 0; i < symbols_count; ++i) {
+            bit_string.Update(bit_writer, ARCHIVED_BYTE, symbols[i]);
+        }
+        int32_t max_symbol_code_size = code_length[symbols[symbols_count - 1]];
+        std::array<int32_t, MAX_CODE_LENGTH + 1> count_of_length{};
+        for (int32_t i = 0; i < symbols_count; ++i) {
+            count_of_length[code_length[symbols[i]]]++;
         }
         for (int32_t i = 1; i <= max_symbol_code_size; ++i) {
             bit_string.Update(bit_writer, ARCHIVED_BYTE, count_of_length[i]);
         }
-        for (size_t i = 0; i < filename.size(); ++i) {
-            bit_string.Update(bit_writer, code_length[filename[i]], code[filename[i]]);
+    }
+    template <typename Writer>
+    void WriteGamma(Writer &bit_writer, BitString &bit_string, uint32_t value) {
+        int32_t high_bit = 31 - __builtin_clz(value);
+        bit_string.Update(bit_writer, high_bit, 0);
+        bit_string.Update(bit_writer, high_bit + 1, value);
+    }
+    template <typename Writer>
+    void WriteCompactCodeTable(Writer &bit_writer, BitString &bit_string, const SymbolLengths &code_length) {
+        int32_t symbols_count = 0;
+        for (int32_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+            symbols_count += code_length[symbol] > 0;
+        }
+        bit_string.Update(bit_writer, ARCHIVED_BYTE, symbols_count);
+        int32_t previous_symbol = -1;
+        int32_t previous_length = 0;
+        for (int32_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+            if (code_length[symbol] == 0) {
+                continue;
+            }
+            int32_t change = code_length[symbol] - previous_length;
+            WriteGamma(bit_writer, bit_string, symbol - previous_symbol);
+            WriteGamma(bit_writer, bit_string, (change >= 0 ? 2 * change : -2 * change - 1) + 1);
+            previous_symbol = symbol;
+            previous_length = code_length[symbol];
         }
-        bit_string.Update(bit_writer, code_length[FILENAME_END], code[FILENAME_END]);
-        while (not bit_reader.Empty()) {
-            int16_t symbol = bit_reader.ReadNext();
-            bit_string.Update(bit_writer, code_length[symbol], code[symbol]);
+    }
+    // Clusters the contexts of the block, builds the code of every group and returns the context block size.
+    size_t SetContextCodes(const unsigned char *data, size_t size) {
+        {
+            StageTimer timer(Stage::HISTOGRAM);
+            context_model_.Count(data, size);
+        }
+        StageTimer timer(Stage::TREE);
+        int32_t groups_count = context_model_.Cluster(context_groups_);
+        group_length_.resize(groups_count);
+        group_code_.resize(groups_count);
+        uint64_t bits = 0;
+        for (int32_t group = 0; group < groups_count; ++group) {
+            const SymbolFrequencies &frequency = context_model_.GetFrequency(group);
+            SymbolList symbols;
+            int32_t symbols_count = SetCodeLengths(frequency, group_length_[group], symbols);
+            SetCanonicalCodes(group_length_[group], symbols, symbols_count, group_code_[group]);
+            for (int32_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+                bits += static_cast<uint64_t>(frequency[symbol]) * group_length_[group][symbol];
+            }
+        }
+        ByteCounter counter;
+        BitString bit_string(0, 0);
+        WriteContextHeader(counter, bit_string);
+        return 1 + counter.Size() + (bit_string.GetLength() + bits + BYTE - 1) / BYTE;
+    }
+    template <typename Writer>
+    void WriteContextHeader(Writer &bit_writer, BitString &bit_string) {
+        int32_t groups_count = context_model_.GetGroupsCount();
+        const std::array<uint8_t, CONTEXTS_COUNT> &groups = context_model_.GetGroups();
+        bit_string.Update(bit_writer, ARCHIVED_BYTE, max_code_length_);
+        bit_string.Update(bit_writer, ARCHIVED_BYTE, groups_count);
+        int32_t group_bits = GroupBits(groups_count);
+        for (int32_t context = 0; context < CONTEXTS_COUNT;) {
+            int32_t end = context + 1;
+            while (end < CONTEXTS_COUNT and groups[end] == groups[context]) {
+                ++end;
+            }
+            bit_string.Update(bit_writer, group_bits, groups[context]);
+            WriteGamma(bit_writer, bit_string, end - context);
+            context = end;
+        }
+        for (int32_t group = 0; group < groups_count; ++group) {
+            WriteCompactCodeTable(bit_writer, bit_string, group_length_[group]);
+        }
+    }
+    template <typename Writer>
+    void EncodeContext(const unsigned char *data, size_t size, Writer &bit_writer) {
+        StageTimer timer(Stage::ENCODE);
+        Statistics::Add(Counter::CONTEXT_BLOCKS, 1);
+        const std::array<uint8_t, CONTEXTS_COUNT> &groups = context_model_.GetGroups();
+        for (int32_t group = 0; group < context_model_.GetGroupsCount(); ++group) {
+            Statistics::AddCodeLengths(context_model_.GetFrequency(group), group_length_[group]);
+        }
+        std::array<const int16_t *, CONTEXTS_COUNT> context_length;
+        std::array<const uint32_t *, CONTEXTS_COUNT> context_code;
+        for (int32_t context = 0; context < CONTEXTS_COUNT; ++context) {
+            context_length[context] = group_length_[groups[context]].data();
+            context_code[context] = group_code_[groups[context]].data();
+        }
+        int32_t max_length = 0;
+        for (int32_t group = 0; group < context_model_.GetGroupsCount(); ++group) {
+            max_length = std::max(max_length, LongestCode(group_length_[group].data()));
+        }
+        bit_writer.WriteNext(static_cast<char>(CONTEXT_BLOCK));
+        BitString bit_string(0, 0);
+        WriteContextHeader(bit_writer, bit_string);
+        bit_string.Update(bit_writer, context_length[0][data[0]], context_code[0][data[0]]);
+        bit_string.EncodeInContext(bit_writer, data + 1, size - 1, context_length.data(), context_code.data(),
+                                   max_length);
+        bit_string.Flush(bit_writer);
+    }
+    // Codes tokens_ as an LZ block; returns false without writing anything when the block would not be smaller
+    // than the stored one.
+    template <typename Writer>
+    bool EncodeLz(size_t size, Writer &bit_writer) {
+        SymbolFrequencies literal_frequency{};
+        SymbolFrequencies distance_frequency{};
+        uint64_t bits = 0;
+        for (const LzToken &token : tokens_) {
+            if (token.length == 0) {
+                ++literal_frequency[token.value];
+                continue;
+            }
+            ValueCode length_code = GetValueCode(token.length - MIN_MATCH_LENGTH);
+            ValueCode distance_code = GetValueCode(token.value - 1);
+            ++literal_frequency[ALPHABET_SIZE + length_code.code];
+            ++distance_frequency[distance_code.code];
+            bits += length_code.extra_bits_count + distance_code.extra_bits_count;
+        }
+        SymbolLengths literal_length;
+        SymbolList literal_symbols;
+        SymbolCodes literal_code;
+        SymbolLengths distance_length;
+        SymbolList distance_symbols;
+        SymbolCodes distance_code;
+        int32_t literal_count = 0;
+        int32_t distance_count = 0;
+        {
+            StageTimer timer(Stage::TREE);
+            literal_count = huffman_tree_.Build(literal_frequency, ALPHABET_SIZE + LENGTH_CODES_COUNT,
+                                                max_code_length_, literal_length, literal_symbols);
+            SetCanonicalCodes(literal_length, literal_symbols, literal_count, literal_code);
+            distance_count = huffman_tree_.Build(distance_frequency, DISTANCE_CODES_COUNT, max_code_length_,
+                                                 distance_length, distance_symbols);
+            SetCanonicalCodes(distance_length, distance_symbols, distance_count, distance_code);
+        }
+        bits += static_cast<uint64_t>(ARCHIVED_BYTE) * (3 + literal_count + distance_count + 2 * MAX_CODE_LENGTH);
+        for (int32_t symbol = 0; symbol < ALPHABET_SIZE + LENGTH_CODES_COUNT; ++symbol) {
+            if (literal_frequency[symbol] > 0) {
+                bits += static_cast<uint64_t>(literal_frequency[symbol]) * literal_length[symbol];
+            }
+        }
+        for (int32_t symbol = 0; symbol < DISTANCE_CODES_COUNT; ++symbol) {
+            if (distance_frequency[symbol] > 0) {
+                bits += static_cast<uint64_t>(distance_frequency[symbol]) * distance_length[symbol];
+            }
+        }
+        if (2 + bits / BYTE >= size) {
+            return false;
         }
-        if (is_file_last) {
-            bit_string.Update(bit_writer, code_length[ARCHIVE_END], code[ARCHIVE_END]);
 
-            bit_string.AddBits(BYTE - bit_string.GetLength(), 0);
-            bit_writer.WriteNext(bit_string.GetBits(BYTE));
+        StageTimer timer(Stage::ENCODE);
+        Statistics::Add(Counter::LZ_BLOCKS, 1);
+        bit_writer.WriteNext(static_cast<char>(LZ_BLOCK));
+        BitString bit_string(0, 0);
+        bit_string.Update(bit_writer, ARCHIVED_BYTE, max_code_length_);
+        WriteCodeTable(bit_writer, bit_string, literal_length, literal_symbols, literal_count);
+        WriteCodeTable(bit_writer, bit_string, distance_length, distance_symbols, distance_count);
+        for (const LzToken &token : tokens_) {
+            if (token.length == 0) {
+                bit_string.Update(bit_writer, literal_length[token.value], literal_code[token.value]);
+                continue;
+            }
+            ValueCode length_code = GetValueCode(token.length - MIN_MATCH_LENGTH);
+            int32_t symbol = ALPHABET_SIZE + length_code.code;
+            bit_string.Update(bit_writer, literal_length[symbol], literal_code[symbol]);
+            bit_string.Update(bit_writer, length_code.extra_bits_count, length_code.extra_bits);
+            ValueCode value_code = GetValueCode(token.value - 1);
+            bit_string.Update(bit_writer, distance_length[value_code.code], distance_code[value_code.code]);
+            bit_string.Update(bit_writer, value_code.extra_bits_count, value_code.extra_bits);
+        }
+        bit_string.Flush(bit_writer);
+        return true;
+    }
+    void DecodeLz(MemoryReader &bit_reader, BitString &bit_string, unsigned char *output, size_t size) {
+        bool has_distances = false;
+        {
+            StageTimer timer(Stage::DECODE_TABLE);
+            int16_t max_code_length = ReadMaxCodeLength(bit_reader, bit_string);
+            if (ReadCodeTable(bit_reader, bit_string, ALPHABET_SIZE + LENGTH_CODES_COUNT, max_code_length,
+                              decode_table_) == 0) {
+                throw ArchiveException("Corrupted code table");
+            }
+            has_distances = ReadCodeTable(bit_reader, bit_string, DISTANCE_CODES_COUNT, max_code_length,
+                                          distance_table_) > 0;
+        }
 
-            bit_writer.OutBuffer();
-        } else {
-            bit_string.Update(bit_writer, code_length[ONE_MORE_FILE], code[ONE_MORE_FILE]);
+        StageTimer timer(Stage::DECODE);
+        int32_t padding_size = 0;
+        size_t position = 0;
+        while (position < size) {
+            RefillPadded(bit_reader, bit_string, padding_size);
+            int32_t symbol = decode_table_.Decode(bit_string);
+            if (symbol < ALPHABET_SIZE) {
+                output[position++] = static_cast<unsigned char>(symbol);
+                continue;
+            }
+            if (not has_distances) {
+                throw ArchiveException("Corrupted match");
+            }
+            int32_t extra_bits_count = 0;
+            size_t length = MIN_MATCH_LENGTH + GetValueBase(symbol - ALPHABET_SIZE, extra_bits_count);
+            if (extra_bits_count > 0) {
+                length += bit_string.GetBits(extra_bits_count);
+            }
+            RefillPadded(bit_reader, bit_string, padding_size);
+            size_t distance = 1 + GetValueBase(distance_table_.Decode(bit_string), extra_bits_count);
+            if (extra_bits_count > 0) {
+                distance += bit_string.GetBits(extra_bits_count);
+            }
+            if (distance > position or length > size - position) {
+                throw ArchiveException("Corrupted match");
+            }
+            unsigned char *target = output + position;
+            const unsigned char *source = target - distance;
+            if (distance >= length) {
+                std::copy(source, source + length, target);
+            } else {
+                for (size_t i = 0; i < length; ++i) {
+                    target[i] = source[i];
+                }
+            }
+            position += length;
         }
     }
+    void DecodeContext(MemoryReader &bit_reader, BitString &bit_string, unsigned char *output, size_t size) {
+        std::array<const DecodeTable *, CONTEXTS_COUNT> context_table;
+        int32_t max_length = 1;
+        {
+            StageTimer timer(Stage::DECODE_TABLE);
+            int16_t max_code_length = ReadMaxCodeLength(bit_reader, bit_string);
+            int32_t groups_count = ReadArchivedBits(bit_reader, bit_string, ARCHIVED_BYTE);
+            if (groups_count < 1 or groups_count > MAX_CONTEXT_GROUPS) {
+                throw ArchiveException("Unsupported context groups count " + std::to_string(groups_count));
+            }
+            group_tables_.resize(groups_count);
+            int32_t group_bits = GroupBits(groups_count);
+            for (int32_t context = 0; context < CONTEXTS_COUNT;) {
+                int32_t group = ReadArchivedBits(bit_reader, bit_string, group_bits);
+                uint32_t run = ReadGamma(bit_reader, bit_string);
+                if (group >= groups_count or run > static_cast<uint32_t>(CONTEXTS_COUNT - context)) {
+                    throw ArchiveException("Corrupted context map");
+                }
+                for (uint32_t i = 0; i < run; ++i) {
+                    context_table[context++] = &group_tables_[group];
+                }
+            }
+            for (DecodeTable &table : group_tables_) {
+                if (ReadCompactCodeTable(bit_reader, bit_string, max_code_length, table) == 0) {
+                    throw ArchiveException("Corrupted code table");
+                }
+                max_length = std::max(max_length, static_cast<int32_t>(table.GetMaxLength()));
+            }
+        }
 
-    bool DecodeFile(BitReader<in_stream> &bit_reader, BitString &bit_string) {
-        unsigned char byte = bit_reader.ReadNext();
-        bit_string.AddBits(BYTE, byte);
-        if (not bit_string.IsResidueFull(ARCHIVED_BYTE)) {
-            byte = bit_reader.ReadNext();
-            bit_string.AddBits(BYTE, byte);
+        StageTimer timer(Stage::DECODE);
+        int32_t symbols_per_refill = BitString::REFILLED_LENGTH / max_length;
+        int32_t padding_size = 0;
+        unsigned char context = 0;
+        size_t position = 0;
+        while (position < size) {
+            RefillPadded(bit_reader, bit_string, padding_size);
+            size_t end = std::min(size, position + symbols_per_refill);
+            for (; position < end; ++position) {
+                context = static_cast<unsigned char>(context_table[context]->Decode(bit_string));
+                output[position] = context;
+            }
+        }
+    }
+    // Tops bit_string up to REFILLED_LENGTH bits, with zeros past the end of the block. A valid block never reads
+    // more than a byte into the zeros, so a block that needs many of them is cut short.
+    void RefillPadded(MemoryReader &bit_reader, BitString &bit_string, int32_t &padding_size) {
+        bit_string.Refill(bit_reader);
+        while (not bit_string.IsResidueFull(BitString::REFILLED_LENGTH)) {
+            if (++padding_size > MAX_PADDING_SIZE) {
+                throw ArchiveException("Unexpected end of block");
+            }
+            bit_string.AddBits(BYTE, 0);
+        }
+    }
+    // Payload size of a Huffman block with the given code, rounded up for the padding of every stream.
+    size_t HuffmanSize(const SymbolFrequencies &symbol_frequency, const SymbolLengths &code_length,
+                       int32_t symbols_count) const {
+        uint64_t bits = static_cast<uint64_t>(ARCHIVED_BYTE) * (3 + symbols_count + MAX_CODE_LENGTH);
+        bits += CodedBits(symbol_frequency, code_length);
+        return 1 + bits / BYTE + 4 * (streams_count_ - 1) + streams_count_;
+    }
+    static uint64_t CodedBits(const SymbolFrequencies &symbol_frequency, const SymbolLengths &code_length) {
+        uint64_t bits = 0;
+        for (int32_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+            if (symbol_frequency[symbol] > 0) {
+                bits += static_cast<uint64_t>(symbol_frequency[symbol]) * code_length[symbol];
+            }
+        }
+        return bits;
+    }
+    void DecodeRunLength(const unsigned char *payload, size_t payload_size, unsigned char *output, size_t size) {
+        size_t position = 0;
+        size_t index = 0;
+        while (position < size) {
+            if (index == payload_size) {
+                throw ArchiveException("Unexpected end of block");
+            }
+            unsigned char symbol = payload[index++];
+            uint64_t extra = 0;
+            for (int32_t shift = 0; true; shift += 7) {
+                if (index == payload_size or shift > 56) {
+                    throw ArchiveException("Corrupted run length");
+                }
+                unsigned char byte = payload[index++];
+                extra |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if (byte < 0x80) {
+                    break;
+                }
+            }
+            if (extra >= size - position) {
+                throw ArchiveException("Corrupted run length");
+            }
+            std::fill(output + position, output + position + extra + 1, symbol);
+            position += extra + 1;
+        }
+    }
+    void CountFrequencies(const unsigned char *data, size_t size, SymbolFrequencies &symbol_frequency) {
+        symbol_frequency.fill(0);
+        CountBytes(data, size, symbol_frequency);
+    }
+    int32_t SetCodeLengths(const SymbolFrequencies &symbol_frequency, SymbolLengths &code_length,
+                           SymbolList &symbols) {
+        return huffman_tree_.Build(symbol_frequency, ALPHABET_SIZE, max_code_length_, code_length, symbols);
+    }
+    int16_t ReadMaxCodeLength(MemoryReader &bit_reader, BitString &bit_string) {
+        int16_t max_code_length = ReadArchivedBits(bit_reader, bit_string, ARCHIVED_BYTE);
+        if (max_code_length > MAX_CODE_LENGTH) {
+            throw ArchiveException("Unsupported maximum code length " + std::to_string(max_code_length));
+        }
+        return max_code_length;
+    }
+    static int32_t GroupBits(int32_t groups_count) {
+        return groups_count > 1 ? 32 - __builtin_clz(groups_count - 1) : 0;
+    }
+    uint32_t ReadGamma(MemoryReader &bit_reader, BitString &bit_string) {
+        int32_t high_bit = 0;
+        while (ReadArchivedBits(bit_reader, bit_string, 1) == 0) {
+            if (++high_bit > MAX_GAMMA_BITS) {
+                throw ArchiveException("Corrupted code table");
+            }
+        }
+        uint32_t value = 1u << high_bit;
+        if (high_bit > 0) {
+            value |= static_cast<uint16_t>(ReadArchivedBits(bit_reader, bit_string, high_bit));
+        }
+        return value;
+    }
+    // Reads a compact code table over bytes into table and returns its symbols count.
+    int32_t ReadCompactCodeTable(MemoryReader &bit_reader, BitString &bit_string, int16_t max_code_length,
+                                 DecodeTable &table) {
+        int32_t symbols_count = ReadArchivedBits(bit_reader, bit_string, ARCHIVED_BYTE);
+        if (symbols_count > ALPHABET_SIZE) {
+            throw ArchiveException("Corrupted code table");
         }
-        int32_t symbols_count = bit_string.GetBits(ARCHIVED_BYTE);
         std::vector<std::pair<int16_t, int16_t>> symbols_and_lengths(symbols_count);
+        int32_t symbol = -1;
+        int32_t length = 0;
         for (int32_t i = 0; i < symbols_count; ++i) {
-            byte = bit_reader.ReadNext();
-            bit_string.AddBits(BYTE, byte);
-            if (not bit_string.IsResidueFull(ARCHIVED_BYTE)) {
-                byte = bit_reader.ReadNext();
-                bit_string.AddBits(BYTE, byte);
+            symbol += ReadGamma(bit_reader, bit_string);
+            uint32_t change = ReadGamma(bit_reader, bit_string) - 1;
+            length += change % 2 == 0 ? change / 2 : -static_cast<int32_t>(change / 2) - 1;
+            if (symbol >= ALPHABET_SIZE or length < 1 or length > max_code_length) {
+                throw ArchiveException("Corrupted code table");
+            }
+            symbols_and_lengths[i] = {length, symbol};
+        }
+        sort(symbols_and_lengths.begin(), symbols_and_lengths.end());
+        if (not IsPrefixCode(symbols_and_lengths)) {
+            throw ArchiveException("Corrupted code table");
+        }
+        table.Build(symbols_and_lengths);
+        return symbols_count;
+    }
+    // Reads the header of a Huffman block into decode_table_ and returns the streams count.
+    int32_t ReadHuffmanHeader(MemoryReader &bit_reader, BitString &bit_string) {
+        int16_t max_code_length = ReadMaxCodeLength(bit_reader, bit_string);
+        int32_t streams_count = ReadArchivedBits(bit_reader, bit_string, ARCHIVED_BYTE);
+        if (streams_count != 1 and streams_count != 4 and streams_count != MAX_STREAMS_COUNT) {
+            throw ArchiveException("Unsupported streams count " + std::to_string(streams_count));
+        }
+        if (ReadCodeTable(bit_reader, bit_string, ALPHABET_SIZE, max_code_length, decode_table_, true) == 0) {
+            throw ArchiveException("Corrupted code table");
+        }
+        return streams_count;
+    }
+    // Reads a code table over symbols below alphabet_size into table and returns its symbols count.
+    int32_t ReadCodeTable(MemoryReader &bit_reader, BitString &bit_string, int32_t alphabet_size,
+                          int16_t max_code_length, DecodeTable &table, bool is_full_width = false) {
+        int32_t symbols_count = ReadArchivedBits(bit_reader, bit_string, ARCHIVED_BYTE);
+        if (symbols_count > alphabet_size) {
+            throw ArchiveException("Corrupted code table");
+        }
+        std::vector<std::pair<int16_t, int16_t>> symbols_and_lengths(symbols_count);
+        for (int32_t i = 0; i < symbols_count; ++i) {
+            int16_t symbol = ReadArchivedBits(bit_reader, bit_string, ARCHIVED_BYTE);
+            if (symbol >= alphabet_size) {
+                throw ArchiveException("Corrupted code table");
             }
-            int16_t symbol = bit_string.GetBits(ARCHIVED_BYTE);
             symbols_and_lengths[i] = {-1, symbol};
         }
 
         int32_t current_index = 0;
         for (int16_t current_length = 1; current_index < symbols_count; ++current_length) {
-            byte = bit_reader.ReadNext();
-            bit_string.AddBits(BYTE, byte);
-            if (not bit_string.IsResidueFull(ARCHIVED_BYTE)) {
-                byte = bit_reader.ReadNext();
-                bit_string.AddBits(BYTE, byte);
+            if (current_length > max_code_length) {
+                throw ArchiveException("Code length exceeds the limit recorded in the archive header");
+            }
+            int16_t length_count = ReadArchivedBits(bit_reader, bit_string, ARCHIVED_BYTE);
+            if (length_count > symbols_count - current_index) {
+                throw ArchiveException("Corrupted code table");
             }
-            int16_t length_count = bit_string.GetBits(ARCHIVED_BYTE);
             for (int16_t j = 0; j < length_count; ++j) {
                 symbols_and_lengths[current_index + j].first = current_length;
             }
@@ -114,107 +765,64 @@ public:
         }
 
         sort(symbols_and_lengths.begin(), symbols_and_lengths.end());
-        int32_t current_code = 0;
-        int32_t current_length = 0;
-        std::unordered_map<int16_t, int32_t> code;
-        for (size_t i = 0; i < symbols_and_lengths.size(); ++i) {
-            current_code <<= symbols_and_lengths[i].first - current_length;
-            current_length = symbols_and_lengths[i].first;
-            code[symbols_and_lengths[i].second] = current_code;
-            ++current_code;
-        }
-        TrieNodePtr root(new TrieNode);
-        for (const auto &[length, symbol] : symbols_and_lengths) {
-            AddPath(root, length, code[symbol], symbol);
-        }
-
-        //-------------------------------------------------------------------------------------------------
-
-        std::string filename = GetFilename(root, bit_reader, bit_string);
-        TrieNodePtr current_node = root;
-        BitWriter<out_stream> bit_writer(filename);
-        bool end_of_file = false;
-        bool end_of_archive = false;
-        while (not end_of_file) {
-            byte = bit_reader.ReadNext();
-            bit_string.AddBits(BYTE, byte);
-            while (not end_of_file and bit_string.IsResidueFull(BIT)) {
-                int16_t bit = bit_string.GetBits(BIT);
-                current_node = current_node->Next(bit ? Edge::Right : Edge::Left);
-                if (current_node->GetTerminal()) {
-                    int16_t symbol = current_node->GetSymbol();
-                    if (symbol == ARCHIVE_END) {
-                        end_of_file = true;
-                        end_of_archive = true;
-                    } else if (symbol == ONE_MORE_FILE) {
-                        end_of_file = true;
-                    } else {
-                        bit_writer.WriteNext(static_cast<char>(symbol));
-                    }
-                    current_node = root;
+        if (not IsPrefixCode(symbols_and_lengths)) {
+            throw ArchiveException("Corrupted code table");
+        }
+        table.Build(symbols_and_lengths, is_full_width);
+        return symbols_count;
+    }
+    // Decodes STREAMS equal segments of output from a full-width table. While every stream holds a whole load the
+    // kernel for the shape of the table decodes them, taking turns symbol by symbol so the table lookups of different
+    // streams overlap; the ends of the segments are finished one by one, padded like the LZ and context streams.
+    template <int32_t STREAMS>
+    void DecodeStreams(const DecodeTable &table, MemoryReader *bit_readers, BitString *bit_strings,
+                       unsigned char *output, size_t size) {
+        int32_t max_length = table.GetMaxLength();
+        size_t segment_size = (size + STREAMS - 1) / STREAMS;
+        std::array<size_t, STREAMS> positions;
+        std::array<size_t, STREAMS> ends;
+        for (int32_t i = 0; i < STREAMS; ++i) {
+            positions[i] = std::min(i * segment_size, size);
+            ends[i] = std::min(positions[i] + segment_size, size);
+        }
+        DecodeKernelFor<STREAMS>(max_length)(table.GetEntries(), bit_readers, bit_strings, output, positions.data(),
+                                             ends[STREAMS - 1] - positions[STREAMS - 1]);
+        int32_t symbols_per_refill = BitString::REFILLED_LENGTH / std::max(max_length, 1);
+        for (int32_t i = 0; i < STREAMS; ++i) {
+            int32_t padding_size = 0;
+            while (positions[i] < ends[i]) {
+                RefillPadded(bit_readers[i], bit_strings[i], padding_size);
+                size_t end = std::min(ends[i], positions[i] + symbols_per_refill);
+                for (; positions[i] < end; ++positions[i]) {
+                    output[positions[i]] = static_cast<unsigned char>(table.Decode(bit_strings[i]));
                 }
             }
         }
-        bit_writer.OutBuffer();
-        return end_of_archive;
     }
-
-private:
-    void CountFrequencies(BitReader<in_stream> &bit_reader, std::unordered_map<int16_t, size_t> &symbol_frequency) {
-        while (not bit_reader.Empty()) {
-            unsigned char symbol = bit_reader.ReadNext();
-            ++symbol_frequency[symbol];
-        }
-    }
-    void SetCodeLengths(const std::unordered_map<int16_t, size_t> &symbol_frequency,
-                        std::unordered_map<int16_t, int16_t> &code_length, std::vector<TrieNodePtr> &trie_nodes) {
-        PriorityQueue<TrieNodePtr, std::vector<TrieNodePtr>, decltype(&TrieNodeLess)> priority_queue(&TrieNodeLess);
-        for (const auto &[symbol, frequency] : symbol_frequency) {
-            TrieNodePtr new_node = TrieNodePtr(new TrieNode(true, symbol, frequency));
-            priority_queue.Insert(new_node);
-            trie_nodes.push_back(new_node);
-        }
-        while (priority_queue.Size() > 1) {
-            TrieNodePtr first_min_node = priority_queue.ExtractRoot();
-            TrieNodePtr second_min_node = priority_queue.ExtractRoot();
-            TrieNodePtr merged_node = MergeTries(first_min_node, second_min_node);
-            priority_queue.Insert(merged_node);
-        }
-
-        TrieNodePtr root = priority_queue.GetRoot();
-        DFS(0, root, code_length);
-    }
-    void SetCodes(std::unordered_map<int16_t, int16_t> &code_length, std::vector<TrieNodePtr> &trie_nodes,
-                  std::unordered_map<int16_t, int32_t> &code) {
-        sort(trie_nodes.begin(), trie_nodes.end(), TrieNodeGreater);
-        int32_t current_code = 0;
-        int32_t current_length = 0;
-        for (size_t i = 0; i < trie_nodes.size(); ++i) {
-            current_code <<= code_length[trie_nodes[i]->GetSymbol()] - current_length;
-            current_length = code_length[trie_nodes[i]->GetSymbol()];
-            code[trie_nodes[i]->GetSymbol()] = current_code;
-            ++current_code;
-        }
-    }
-    std::string GetFilename(TrieNodePtr root, BitReader<in_stream> &bit_reader, BitString &bit_string) {
-        TrieNodePtr current_node = root;
-        std::string filename;
-        while (true) {
-            unsigned char byte = bit_reader.ReadNext();
-            bit_string.AddBits(BYTE, byte);
-            while (bit_string.IsResidueFull(BIT)) {
-                int16_t bit = bit_string.GetBits(BIT);
-                current_node = current_node->Next(bit ? Edge::Right : Edge::Left);
-                if (current_node->GetTerminal()) {
-                    int16_t symbol = current_node->GetSymbol();
-                    if (symbol == FILENAME_END) {
-                        return filename;
-                    } else {
-                        filename += static_cast<char>(symbol);
-                    }
-                    current_node = root;
-                }
+    int16_t ReadArchivedBits(MemoryReader &bit_reader, BitString &bit_string, int32_t bits_count) {
+        while (not bit_string.IsResidueFull(bits_count)) {
+            if (bit_reader.Empty()) {
+                throw ArchiveException("Unexpected end of block");
             }
+            bit_string.AddBits(BYTE, bit_reader.ReadNext());
         }
+        return bit_string.GetBits(bits_count);
     }
+
+    static const int32_t MAX_PADDING_SIZE = 16;
+    static const int32_t MAX_GAMMA_BITS = 15;
+    int16_t max_code_length_;
+    int32_t streams_count_;
+    int32_t lz_level_;
+    int32_t context_groups_;
+    const Dictionary *dictionary_;
+    MatchFinder match_finder_;
+    std::vector<LzToken> tokens_;
+    HuffmanTree huffman_tree_;
+    DecodeTable decode_table_;
+    DecodeTable distance_table_;
+    ContextModel context_model_;
+    std::vector<SymbolLengths> group_length_;
+    std::vector<SymbolCodes> group_code_;
+    std::vector<DecodeTable> group_tables_;
 };
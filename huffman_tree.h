@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "package_merge.h"
+
+using SymbolFrequencies = std::array<size_t, MAX_ALPHABET_SIZE>;
+using SymbolLengths = std::array<int16_t, MAX_ALPHABET_SIZE>;
+using SymbolCodes = std::array<uint32_t, MAX_ALPHABET_SIZE>;
+using SymbolList = std::array<int16_t, MAX_ALPHABET_SIZE>;
+
+// Huffman tree over a contiguous node array: leaves come first in ascending frequency, internal nodes follow in the
+// order the two-queue method creates them, so both queues stay sorted and a node's parent always has a larger index.
+class HuffmanTree {
+public:
+    // Fills code_length for every symbol with non-zero frequency and lists those symbols in ascending frequency.
+    // Returns the number of listed symbols.
+    int32_t Build(const SymbolFrequencies &frequency, int32_t alphabet_size, int16_t max_code_length,
+                  SymbolLengths &code_length, SymbolList &symbols) {
+        int32_t leaves_count = 0;
+        for (int32_t symbol = 0; symbol < alphabet_size; ++symbol) {
+            code_length[symbol] = 0;
+            if (frequency[symbol] > 0) {
+                symbols[leaves_count++] = static_cast<int16_t>(symbol);
+            }
+        }
+        std::sort(symbols.begin(), symbols.begin() + leaves_count, [&frequency](int16_t first, int16_t second) {
+            if (frequency[first] == frequency[second]) {
+                return first < second;
+            }
+            return frequency[first] < frequency[second];
+        });
+        if (leaves_count == 1) {
+            code_length[symbols[0]] = 1;
+        }
+        if (leaves_count <= 1) {
+            return leaves_count;
+        }
+
+        for (int32_t i = 0; i < leaves_count; ++i) {
+            weight_[i] = frequency[symbols[i]];
+        }
+        int32_t next_leaf = 0;
+        int32_t next_internal = leaves_count;
+        int32_t nodes_count = leaves_count;
+        while (nodes_count < 2 * leaves_count - 1) {
+            int32_t children[2];
+            for (int32_t &child : children) {
+                if (next_internal == nodes_count or
+                    (next_leaf < leaves_count and weight_[next_leaf] <= weight_[next_internal])) {
+                    child = next_leaf++;
+                } else {
+                    child = next_internal++;
+                }
+            }
+            weight_[nodes_count] = weight_[children[0]] + weight_[children[1]];
+            parent_[children[0]] = parent_[children[1]] = nodes_count;
+            ++nodes_count;
+        }
+
+        int32_t root = nodes_count - 1;
+        depth_[root] = 0;
+        int16_t max_depth = 0;
+        for (int32_t node = root - 1; node >= 0; --node) {
+            depth_[node] = static_cast<int16_t>(depth_[parent_[node]] + 1);
+            max_depth = std::max(max_depth, depth_[node]);
+        }
+
+        if (max_depth > max_code_length) {
+            for (int32_t i = 0; i < leaves_count; ++i) {
+                weight_[i] = frequency[symbols[i]];
+            }
+            PackageMerge(weight_.data(), leaves_count, max_code_length, depth_.data());
+        }
+        for (int32_t i = 0; i < leaves_count; ++i) {
+            code_length[symbols[i]] = depth_[i];
+        }
+        return leaves_count;
+    }
+
+private:
+    std::array<size_t, 2 * MAX_ALPHABET_SIZE> weight_;
+    std::array<int32_t, 2 * MAX_ALPHABET_SIZE> parent_;
+    std::array<int16_t, 2 * MAX_ALPHABET_SIZE> depth_;
+};
+
+// Sorts symbols by (code length, symbol) and assigns canonical codes in that order.
+inline void SetCanonicalCodes(const SymbolLengths &code_length, SymbolList &symbols, int32_t symbols_count,
+                              SymbolCodes &code) {
+    std::sort(symbols.begin(), symbols.begin() + symbols_count, [&code_length](int16_t first, int16_t second) {
+        if (code_length[first] == code_length[second]) {
+            return first < second;
+        }
+        return code_length[first] < code_length[second];
+    });
+    uint64_t current_code = 0;
+    int32_t current_length = 0;
+    for (int32_t i = 0; i < symbols_count; ++i) {
+        current_code <<= code_length[symbols[i]] - current_length;
+        current_length = code_length[symbols[i]];
+        code[symbols[i]] = static_cast<uint32_t>(current_code);
+        ++current_code;
+    }
+}
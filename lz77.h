@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+const int32_t MIN_MATCH_LENGTH = 4;
+const size_t MAX_MATCH_LENGTH = (1 << 16) + MIN_MATCH_LENGTH - 1;
+const int32_t MAX_LZ_LEVEL = 9;
+const size_t MIN_LZ_WINDOW = 1 << 10;
+const size_t DEFAULT_LZ_WINDOW = 1 << 18;
+const int32_t LZ_HASH_BITS = 16;
+// ProbeMatches hashes only every LZ_PROBE_STRIDE-th position and counts matches of at least LZ_PROBE_LENGTH bytes.
+const size_t LZ_PROBE_STRIDE = 16;
+const size_t LZ_PROBE_LENGTH = 2 * LZ_PROBE_STRIDE;
+
+// Values below VALUE_CODE_DIRECT are codes of their own; a larger value is coded by the position of its highest bit
+// and the bit below it, and the bits under those follow the code as they are.
+const uint32_t VALUE_CODE_DIRECT = 8;
+const int32_t LENGTH_CODES_COUNT = 34;
+const int32_t DISTANCE_CODES_COUNT = 54;
+
+struct ValueCode {
+    int32_t code = 0;
+    int32_t extra_bits_count = 0;
+    uint32_t extra_bits = 0;
+};
+
+inline ValueCode GetValueCode(uint32_t value) {
+    if (value < VALUE_CODE_DIRECT) {
+        return ValueCode{static_cast<int32_t>(value), 0, 0};
+    }
+    int32_t high_bit = 31 - __builtin_clz(value);
+    ValueCode value_code;
+    value_code.code = 2 * high_bit + 2 + static_cast<int32_t>((value >> (high_bit - 1)) & 1);
+    value_code.extra_bits_count = high_bit - 1;
+    value_code.extra_bits = value & ((1u << (high_bit - 1)) - 1);
+    return value_code;
+}
+
+// Smallest value of a code; extra_bits_count receives the number of bits to add to it.
+inline uint32_t GetValueBase(int32_t code, int32_t &extra_bits_count) {
+    if (code < static_cast<int32_t>(VALUE_CODE_DIRECT)) {
+        extra_bits_count = 0;
+        return code;
+    }
+    int32_t high_bit = (code - 2) / 2;
+    extra_bits_count = high_bit - 1;
+    return (1u << high_bit) | (static_cast<uint32_t>(code & 1) << (high_bit - 1));
+}
+
+// A literal byte when length is 0, otherwise a copy of length bytes from distance bytes back.
+struct LzToken {
+    uint32_t length = 0;
+    uint32_t value = 0;
+};
+
+// Hash-chain match finder over one block. Every position is linked to the previous one with the same 4-byte hash;
+// the level bounds how many links a search follows and, from level 4 up, a match is deferred by one byte when the
+// next position starts a longer one. That second search follows a quarter of the links once the match is good.
+class MatchFinder {
+public:
+    MatchFinder(int32_t level, size_t window) {
+        Configure(level, window);
+    }
+    // Changes the level and window while keeping the buffers of earlier searches.
+    void Configure(int32_t level, size_t window) {
+        max_chain_length_ = 1 << (level + 1);
+        nice_length_ = std::min(MAX_MATCH_LENGTH, static_cast<size_t>(16) << (level / 2));
+        good_length_ = nice_length_ / 4;
+        is_lazy_ = level >= 4;
+        window_ = window;
+    }
+    void FindMatches(const unsigned char *data, size_t size, std::vector<LzToken> &tokens) {
+        tokens.clear();
+        head_.assign(static_cast<size_t>(1) << LZ_HASH_BITS, -1);
+        // Links never reach further back than the window or the start of the block, so the chain covers the smaller.
+        size_t chain_size = 1;
+        while (chain_size < std::min(window_, size)) {
+            chain_size <<= 1;
+        }
+        chain_mask_ = chain_size - 1;
+        chain_.resize(chain_size);
+        data_ = data;
+        size_ = size;
+        inserted_ = 0;
+
+        size_t position = 0;
+        uint32_t distance = 0;
+        size_t length = FindLongestMatch(position, distance, max_chain_length_);
+        while (position < size) {
+            if (length >= MIN_MATCH_LENGTH and is_lazy_ and length < nice_length_) {
+                uint32_t next_distance = 0;
+                int32_t max_chain_length = length >= good_length_ ? max_chain_length_ / 4 : max_chain_length_;
+                size_t next_length = FindLongestMatch(position + 1, next_distance, max_chain_length);
+                if (next_length > length) {
+                    tokens.push_back(LzToken{0, data[position]});
+                    ++position;
+                    length = next_length;
+                    distance = next_distance;
+                    continue;
+                }
+            }
+            if (length >= MIN_MATCH_LENGTH) {
+                tokens.push_back(LzToken{static_cast<uint32_t>(length), distance});
+                position += length;
+            } else {
+                tokens.push_back(LzToken{0, data[position]});
+                ++position;
+            }
+            length = FindLongestMatch(position, distance, max_chain_length_);
+        }
+    }
+    // Quick estimate of how many bytes of a block long matches would cover, for blocks that look incompressible byte
+    // by byte. Every position is looked up but only a sample of them is linked, so a repeat of LZ_PROBE_LENGTH bytes
+    // or more is found in one pass without following chains.
+    size_t ProbeMatches(const unsigned char *data, size_t size) {
+        head_.assign(static_cast<size_t>(1) << LZ_HASH_BITS, -1);
+        data_ = data;
+        size_ = size;
+        size_t covered = 0;
+        size_t sampled = 0;
+        for (size_t position = 0; position + MIN_MATCH_LENGTH <= size;) {
+            for (; sampled < position; sampled += LZ_PROBE_STRIDE) {
+                head_[Hash(sampled)] = static_cast<int32_t>(sampled);
+            }
+            int32_t candidate = head_[Hash(position)];
+            if (candidate >= 0 and position - candidate <= window_) {
+                size_t length = MatchLength(candidate, position, std::min(MAX_MATCH_LENGTH, size - position));
+                if (length >= LZ_PROBE_LENGTH) {
+                    covered += length;
+                    position += length;
+                    continue;
+                }
+            }
+            ++position;
+        }
+        return covered;
+    }
+
+private:
+    uint32_t Hash(size_t position) const {
+        uint32_t bytes;
+        std::memcpy(&bytes, data_ + position, 4);
+        return (bytes * 2654435761u) >> (32 - LZ_HASH_BITS);
+    }
+    // Links every position below end that still has a full hash in front of it.
+    void InsertUpTo(size_t end) {
+        end = std::min(end, size_ >= MIN_MATCH_LENGTH ? size_ - MIN_MATCH_LENGTH + 1 : 0);
+        for (; inserted_ < end; ++inserted_) {
+            int32_t &head = head_[Hash(inserted_)];
+            chain_[inserted_ & chain_mask_] = head;
+            head = static_cast<int32_t>(inserted_);
+        }
+    }
+    size_t MatchLength(size_t candidate, size_t position, size_t max_length) const {
+        size_t length = 0;
+        while (length + 8 <= max_length) {
+            uint64_t first;
+            uint64_t second;
+            std::memcpy(&first, data_ + candidate + length, 8);
+            std::memcpy(&second, data_ + position + length, 8);
+            if (first != second) {
+                return length + (__builtin_ctzll(first ^ second) >> 3);
+            }
+            length += 8;
+        }
+        while (length < max_length and data_[candidate + length] == data_[position + length]) {
+            ++length;
+        }
+        return length;
+    }
+    // Returns the length of the longest earlier match for position (0 if there is none) and links the position.
+    size_t FindLongestMatch(size_t position, uint32_t &distance, int32_t max_chain_length) {
+        if (position + MIN_MATCH_LENGTH > size_) {
+            return 0;
+        }
+        InsertUpTo(position);
+        size_t max_length = std::min(MAX_MATCH_LENGTH, size_ - position);
+        size_t best_length = 0;
+        int32_t candidate = head_[Hash(position)];
+        for (int32_t chain_length = 0; candidate >= 0 and chain_length < max_chain_length; ++chain_length) {
+            if (position - candidate > window_) {
+                break;
+            }
+            if (data_[candidate + best_length] == data_[position + best_length]) {
+                size_t length = MatchLength(candidate, position, max_length);
+                if (length > best_length) {
+                    best_length = length;
+                    distance = static_cast<uint32_t>(position - candidate);
+                    if (length >= nice_length_ or length == max_length) {
+                        break;
+                    }
+                }
+            }
+            candidate = chain_[candidate & chain_mask_];
+        }
+        InsertUpTo(position + 1);
+        return best_length;
+    }
+
+    int32_t max_chain_length_ = 0;
+    size_t nice_length_ = 0;
+    size_t good_length_ = 0;
+    bool is_lazy_ = false;
+    size_t window_ = 0;
+    size_t chain_mask_ = 0;
+    std::vector<int32_t> head_;
+    std::vector<int32_t> chain_;
+    const unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+    size_t inserted_ = 0;
+};
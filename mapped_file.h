@@ -0,0 +1,474 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "buffer_ring.h"
+#include "stats.h"
+
+class FileException : public std::exception {
+public:
+    explicit FileException(const std::string& message) : message_(message) {
+    }
+    const char* what() const noexcept override {
+        return message_.c_str();
+    }
+
+private:
+    std::string message_;
+};
+
+// Input source that maps a regular file into memory once, so every pass over it reads the same pages without
+// copies. Pipes, special files and "-" (stdin) cannot be mapped and are streamed through a buffer as large as the
+// biggest single Read instead, which keeps memory bounded by the caller's block size.
+// With a pipeline buffer size, a streamed input is read ahead by a thread of its own into a ring of buffers of that
+// size while the caller computes, and the kernel is asked to read that far ahead of a mapped file.
+class MappedReader {
+public:
+    explicit MappedReader(std::string filename, size_t pipeline_buffer_size = 0)
+        : readahead_size_(PIPELINE_BUFFERS_COUNT * pipeline_buffer_size / MIN_PIPELINE_BUFFER_SIZE *
+                          MIN_PIPELINE_BUFFER_SIZE) {
+        fd_ = filename == "-" ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            throw FileException("Cannot open " + filename);
+        }
+        struct stat file_stat;
+        if (fstat(fd_, &file_stat) == 0 and S_ISREG(file_stat.st_mode) and file_stat.st_size > 0) {
+            void *mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+                mapping_ = mapping;
+                data_ = static_cast<const unsigned char *>(mapping);
+                size_ = file_stat.st_size;
+            }
+        }
+        if (mapping_ == nullptr and pipeline_buffer_size > 0 and not S_ISREG(file_stat.st_mode)) {
+            ring_ = std::make_unique<BufferRing>(PIPELINE_BUFFERS_COUNT, pipeline_buffer_size);
+            reader_ = std::thread([this] { ReadRing(); });
+        }
+    }
+    MappedReader(const MappedReader &) = delete;
+    MappedReader &operator=(const MappedReader &) = delete;
+    ~MappedReader() {
+        if (ring_ != nullptr) {
+            ring_->Abort();
+            reader_.join();
+        }
+        if (mapping_ != nullptr) {
+            munmap(mapping_, size_);
+        }
+        if (fd_ != STDIN_FILENO) {
+            close(fd_);
+        }
+    }
+    bool IsMapped() const {
+        return mapping_ != nullptr;
+    }
+    size_t Size() const {
+        return size_;
+    }
+    void Seek(size_t position) {
+        if (mapping_ == nullptr) {
+            throw FileException("Input is not seekable");
+        }
+        position_ = std::min(position, size_);
+    }
+    // Offset of the next byte to read, counted from the start for streamed input too.
+    size_t Position() const {
+        return position_;
+    }
+    // Returns up to size bytes, fewer only at the end of the input. For mapped files data stays valid for the
+    // lifetime of the reader, for streamed input only until the next call.
+    size_t Read(const unsigned char *&data, size_t size) {
+        if (mapping_ != nullptr) {
+            size = std::min(size, size_ - position_);
+            data = data_ + position_;
+            position_ += size;
+            Statistics::Add(Counter::BYTES_READ, size);
+            if (readahead_size_ > 0 and position_ + readahead_size_ / 2 > read_ahead_ and read_ahead_ < size_) {
+                // Whole multiples of the readahead size keep the advised range page aligned.
+                read_ahead_ = std::max(read_ahead_, position_ / readahead_size_ * readahead_size_);
+                madvise(const_cast<unsigned char *>(data_) + read_ahead_,
+                        std::min(readahead_size_, size_ - read_ahead_), MADV_WILLNEED);
+                read_ahead_ += readahead_size_;
+            }
+            return size;
+        }
+        if (ring_ != nullptr) {
+            return ReadFromRing(data, size);
+        }
+        if (buffer_.size() < size) {
+            buffer_.resize(size);
+        }
+        size_t filled = ReadUntil(reinterpret_cast<char *>(buffer_.data()), size, [] { return false; });
+        Statistics::Add(Counter::BYTES_READ, filled);
+        position_ += filled;
+        data = buffer_.data();
+        return filled;
+    }
+
+private:
+    // Reads until size bytes or the end of the input, or only until the first bytes when is_enough says so.
+    template <typename IsEnough>
+    size_t ReadUntil(char *buffer, size_t size, IsEnough is_enough) {
+        StageTimer timer(Stage::READ);
+        size_t filled = 0;
+        while (filled < size and (filled == 0 or not is_enough())) {
+            ssize_t count = read(fd_, buffer + filled, size - filled);
+            Statistics::Add(Counter::READ_CALLS, 1);
+            if (count < 0 and errno == EINTR) {
+                continue;
+            }
+            if (count < 0) {
+                throw FileException("Read error");
+            }
+            if (count == 0) {
+                break;
+            }
+            filled += count;
+        }
+        return filled;
+    }
+    // Runs on the reader thread until the end of the input, an error or the destructor.
+    void ReadRing() {
+        while (char *buffer = ring_->AcquireEmpty()) {
+            size_t filled = 0;
+            try {
+                filled = ReadUntil(buffer, ring_->BufferSize(), [this] { return ring_->IsStarving(); });
+            } catch (FileException &e) {
+                error_ = e.what();
+                ring_->Abort();
+                return;
+            }
+            ring_->Push(filled);
+            if (filled == 0) {
+                ring_->Finish();
+                return;
+            }
+        }
+    }
+    // Returns data straight from the ring when the current buffer holds all of it and copies it together otherwise.
+    size_t ReadFromRing(const unsigned char *&data, size_t size) {
+        if (chunk_ != nullptr and chunk_position_ == chunk_size_) {
+            ring_->Release();
+            chunk_ = nullptr;
+        }
+        if (chunk_ == nullptr) {
+            NextChunk();
+        }
+        if (chunk_ != nullptr and chunk_size_ - chunk_position_ >= size) {
+            data = reinterpret_cast<const unsigned char *>(chunk_) + chunk_position_;
+            chunk_position_ += size;
+            Statistics::Add(Counter::BYTES_READ, size);
+            position_ += size;
+            return size;
+        }
+        if (buffer_.size() < size) {
+            buffer_.resize(size);
+        }
+        size_t filled = 0;
+        while (filled < size and chunk_ != nullptr) {
+            size_t count = std::min(size - filled, chunk_size_ - chunk_position_);
+            std::memcpy(buffer_.data() + filled, chunk_ + chunk_position_, count);
+            filled += count;
+            chunk_position_ += count;
+            if (chunk_position_ == chunk_size_) {
+                ring_->Release();
+                NextChunk();
+            }
+        }
+        Statistics::Add(Counter::BYTES_READ, filled);
+        position_ += filled;
+        data = buffer_.data();
+        return filled;
+    }
+    void NextChunk() {
+        chunk_ = ring_->AcquireFull(chunk_size_);
+        chunk_position_ = 0;
+        if (chunk_ == nullptr and not error_.empty()) {
+            throw FileException(error_);
+        }
+    }
+
+    int fd_ = -1;
+    void *mapping_ = nullptr;
+    const unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+    size_t position_ = 0;
+    size_t readahead_size_;
+    size_t read_ahead_ = 0;
+    std::vector<unsigned char> buffer_;
+    std::unique_ptr<BufferRing> ring_;
+    std::thread reader_;
+    std::string error_;
+    const char *chunk_ = nullptr;
+    size_t chunk_size_ = 0;
+    size_t chunk_position_ = 0;
+};
+
+// Buffered output to a file, or to stdout for "-". With a pipeline buffer size, output that outgrows the first
+// buffer is handed to a writer thread through a ring of buffers of that size, so the caller keeps computing while
+// earlier data is written; small files are still written with a single call and start no thread.
+class FileWriter {
+public:
+    explicit FileWriter(std::string filename, size_t pipeline_buffer_size = 0)
+        : buffer_(BUFFER_SIZE), pipeline_buffer_size_(pipeline_buffer_size) {
+        fd_ = filename == "-" ? STDOUT_FILENO : open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) {
+            throw FileException("Cannot create " + filename);
+        }
+        data_ = buffer_.data();
+        capacity_ = BUFFER_SIZE;
+    }
+    // Continues an existing file at offset, overwriting what follows it.
+    FileWriter(std::string filename, size_t pipeline_buffer_size, uint64_t offset)
+        : buffer_(BUFFER_SIZE), pipeline_buffer_size_(pipeline_buffer_size), flushed_(offset) {
+        fd_ = open(filename.c_str(), O_WRONLY);
+        if (fd_ < 0) {
+            throw FileException("Cannot open " + filename);
+        }
+        if (lseek(fd_, offset, SEEK_SET) < 0) {
+            CloseDescriptor();
+            throw FileException("Cannot seek in " + filename);
+        }
+        data_ = buffer_.data();
+        capacity_ = BUFFER_SIZE;
+    }
+    FileWriter(const FileWriter &) = delete;
+    FileWriter &operator=(const FileWriter &) = delete;
+    ~FileWriter() {
+        try {
+            Close();
+        } catch (FileException &) {
+        }
+    }
+    void WriteNext(char symbol) {
+        if (current_index_ == capacity_) {
+            OutBuffer();
+        }
+        data_[current_index_++] = symbol;
+    }
+    void Write(const char *data, size_t size) {
+        if (size >= capacity_ and pipeline_buffer_size_ == 0) {
+            OutBuffer();
+            WriteAll(data, size);
+            flushed_ += size;
+            return;
+        }
+        while (size > 0) {
+            if (current_index_ == capacity_) {
+                OutBuffer();
+            }
+            size_t count = std::min(size, capacity_ - current_index_);
+            std::copy(data, data + count, data_ + current_index_);
+            current_index_ += count;
+            data += count;
+            size -= count;
+        }
+    }
+    // Returns room for at least size bytes (size <= BUFFER_SIZE); Commit reports how many of them were filled.
+    char *Reserve(size_t size) {
+        if (capacity_ - current_index_ < size) {
+            OutBuffer();
+        }
+        return data_ + current_index_;
+    }
+    void Commit(size_t size) {
+        current_index_ += size;
+    }
+    void OutBuffer() {
+        flushed_ += current_index_;
+        if (ring_ == nullptr and pipeline_buffer_size_ > 0) {
+            StartPipeline();
+        }
+        if (ring_ == nullptr) {
+            WriteAll(data_, current_index_);
+            current_index_ = 0;
+            return;
+        }
+        ring_->Push(current_index_);
+        current_index_ = 0;
+        data_ = ring_->AcquireEmpty();
+        if (data_ == nullptr) {
+            writer_.join();
+            ring_.reset();
+            CloseDescriptor();
+            throw FileException(error_);
+        }
+    }
+    uint64_t Position() const {
+        return flushed_ + current_index_;
+    }
+    // Writes out everything buffered so far and stops the writer thread, so the file can be read back up to
+    // Position(). A later write starts a new thread once the output outgrows the first buffer again.
+    void Drain() {
+        if (ring_ == nullptr) {
+            WriteAll(data_, current_index_);
+        } else {
+            ring_->Push(current_index_);
+            ring_->Finish();
+            writer_.join();
+            ring_.reset();
+            buffer_.resize(BUFFER_SIZE);
+            data_ = buffer_.data();
+            capacity_ = BUFFER_SIZE;
+        }
+        flushed_ += current_index_;
+        current_index_ = 0;
+        if (not error_.empty()) {
+            throw FileException(error_);
+        }
+    }
+    void Close() {
+        if (fd_ < 0) {
+            return;
+        }
+        try {
+            Drain();
+        } catch (FileException &) {
+            CloseDescriptor();
+            throw;
+        }
+        CloseDescriptor();
+    }
+
+private:
+    // Moves the buffered bytes into the first buffer of a new ring and starts the writer thread on it.
+    void StartPipeline() {
+        ring_ = std::make_unique<BufferRing>(PIPELINE_BUFFERS_COUNT, pipeline_buffer_size_);
+        char *buffer = ring_->AcquireEmpty();
+        std::copy(data_, data_ + current_index_, buffer);
+        data_ = buffer;
+        capacity_ = ring_->BufferSize();
+        buffer_ = std::vector<char>();
+        writer_ = std::thread([this] { WriteRing(); });
+    }
+    // Runs on the writer thread until the ring is finished or a write fails.
+    void WriteRing() {
+        size_t size = 0;
+        while (const char *data = ring_->AcquireFull(size)) {
+            try {
+                WriteAll(data, size);
+            } catch (FileException &e) {
+                error_ = e.what();
+                ring_->Abort();
+                return;
+            }
+            ring_->Release();
+        }
+    }
+    void WriteAll(const char *data, size_t size) {
+        StageTimer timer(Stage::WRITE);
+        Statistics::Add(Counter::BYTES_WRITTEN, size);
+        while (size > 0) {
+            ssize_t count = write(fd_, data, size);
+            Statistics::Add(Counter::WRITE_CALLS, 1);
+            if (count < 0 and errno == EINTR) {
+                continue;
+            }
+            if (count < 0) {
+                throw FileException("Write error");
+            }
+            data += count;
+            size -= count;
+        }
+    }
+    void CloseDescriptor() {
+        if (fd_ != STDOUT_FILENO) {
+            close(fd_);
+        }
+        fd_ = -1;
+    }
+
+    static const size_t BUFFER_SIZE = 1 << 16;
+    int fd_ = -1;
+    std::vector<char> buffer_;
+    size_t pipeline_buffer_size_;
+    char *data_ = nullptr;
+    size_t capacity_ = 0;
+    size_t current_index_ = 0;
+    uint64_t flushed_ = 0;
+    std::unique_ptr<BufferRing> ring_;
+    std::thread writer_;
+    std::string error_;
+};
+
+// Output file of a known size that is written at arbitrary offsets, so several threads can store their blocks at
+// once. The space is allocated up front to keep the file contiguous, and once it is allocated the file is mapped, so
+// blocks can be decoded straight into it. A file whose space cannot be reserved is only extended and written with
+// pwrite, since storing into a mapping of it could fault when the disk fills up.
+class OutputFile {
+public:
+    OutputFile(std::string filename, uint64_t size) : size_(size) {
+        fd_ = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) {
+            throw FileException("Cannot create " + filename);
+        }
+        if (size == 0) {
+            return;
+        }
+        if (posix_fallocate(fd_, 0, size) != 0) {
+            if (ftruncate(fd_, size) != 0) {
+                close(fd_);
+                throw FileException("Cannot allocate " + filename);
+            }
+            return;
+        }
+        if (size <= SIZE_MAX) {
+            void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (mapping != MAP_FAILED) {
+                data_ = static_cast<unsigned char *>(mapping);
+            }
+        }
+    }
+    OutputFile(const OutputFile &) = delete;
+    OutputFile &operator=(const OutputFile &) = delete;
+    ~OutputFile() {
+        if (data_ != nullptr) {
+            munmap(data_, size_);
+        }
+        close(fd_);
+    }
+    // The mapped contents of the file, or nullptr when it is written with WriteAt only.
+    unsigned char *Data() {
+        return data_;
+    }
+    void WriteAt(const char *data, size_t size, uint64_t offset) {
+        StageTimer timer(Stage::WRITE);
+        Statistics::Add(Counter::BYTES_WRITTEN, size);
+        if (data_ != nullptr) {
+            std::memcpy(data_ + offset, data, size);
+            return;
+        }
+        while (size > 0) {
+            ssize_t count = pwrite(fd_, data, size, offset);
+            Statistics::Add(Counter::WRITE_CALLS, 1);
+            if (count < 0 and errno == EINTR) {
+                continue;
+            }
+            if (count < 0) {
+                throw FileException("Write error");
+            }
+            data += count;
+            size -= count;
+            offset += count;
+        }
+    }
+
+private:
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    unsigned char *data_ = nullptr;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+const int32_t MAX_ALPHABET_SIZE = 512;
+const int16_t MAX_CODE_LENGTH = 32;
+
+// Optimal code lengths bounded by max_length (package-merge). frequencies must be sorted in ascending order and
+// 2^max_length must be at least count; code_lengths[i] receives the length for frequencies[i].
+inline void PackageMerge(const size_t *frequencies, int32_t count, int16_t max_length, int16_t *code_lengths) {
+    static const int32_t LIST_SIZE = 2 * MAX_ALPHABET_SIZE;
+    std::array<std::array<bool, LIST_SIZE>, MAX_CODE_LENGTH> is_package;
+    std::array<int32_t, MAX_CODE_LENGTH> list_size;
+    std::array<size_t, LIST_SIZE> weights;
+    std::array<size_t, LIST_SIZE> merged_weights;
+
+    for (int32_t i = 0; i < count; ++i) {
+        weights[i] = frequencies[i];
+        is_package[max_length - 1][i] = false;
+        code_lengths[i] = 0;
+    }
+    list_size[max_length - 1] = count;
+    for (int32_t level = max_length - 2; level >= 0; --level) {
+        int32_t packages_count = list_size[level + 1] / 2;
+        int32_t leaf = 0;
+        int32_t package = 0;
+        int32_t size = 0;
+        while (leaf < count or package < packages_count) {
+            size_t package_weight = 0;
+            if (package < packages_count) {
+                package_weight = weights[2 * package] + weights[2 * package + 1];
+            }
+            if (package == packages_count or (leaf < count and frequencies[leaf] <= package_weight)) {
+                merged_weights[size] = frequencies[leaf++];
+                is_package[level][size++] = false;
+            } else {
+                merged_weights[size] = package_weight;
+                is_package[level][size++] = true;
+                ++package;
+            }
+        }
+        list_size[level] = size;
+        weights.swap(merged_weights);
+    }
+
+    int32_t taken = 2 * count - 2;
+    for (int32_t level = 0; level < max_length and taken > 0; ++level) {
+        int32_t leaves_taken = 0;
+        for (int32_t i = 0; i < taken; ++i) {
+            leaves_taken += is_package[level][i] ? 0 : 1;
+        }
+        for (int32_t i = 0; i < leaves_taken; ++i) {
+            ++code_lengths[i];
+        }
+        taken = 2 * (taken - leaves_taken);
+    }
+}
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "huffman_tree.h"
+
+// Building with -DARCHIVER_NO_STATS removes every statistics hook; otherwise a hook costs one branch on a flag
+// while statistics are off. Hooks sit at block and system call granularity, never inside the per-symbol loops.
+#ifdef ARCHIVER_NO_STATS
+const bool STATISTICS_BUILT = false;
+#else
+const bool STATISTICS_BUILT = true;
+#endif
+
+enum class Stage { READ, CHECKSUM, HISTOGRAM, MATCH, TREE, ENCODE, DECODE_TABLE, DECODE, WRITE, COUNT };
+enum class Counter {
+    BYTES_READ,
+    BYTES_WRITTEN,
+    READ_CALLS,
+    WRITE_CALLS,
+    BLOCKS,
+    STORED_BLOCKS,
+    RUN_LENGTH_BLOCKS,
+    LZ_BLOCKS,
+    CONTEXT_BLOCKS,
+    DICTIONARY_BLOCKS,
+    COUNT
+};
+
+const char *const STAGE_NAMES[] = {"read",   "checksum",     "histogram", "match", "tree",
+                                   "encode", "decode_table", "decode",    "write"};
+const char *const COUNTER_NAMES[] = {"bytes_read",     "bytes_written",    "read_calls",       "write_calls",
+                                     "blocks",         "stored_blocks",    "run_length_blocks", "lz_blocks",
+                                     "context_blocks", "dictionary_blocks"};
+const int32_t STAGES_COUNT = static_cast<int32_t>(Stage::COUNT);
+const int32_t COUNTERS_COUNT = static_cast<int32_t>(Counter::COUNT);
+
+// Process-wide counters behind --stats. Stage times are summed over all threads, so with -j the wall time of a stage
+// can exceed the elapsed time of the job.
+class Statistics {
+public:
+    static bool IsEnabled() {
+        return STATISTICS_BUILT and enabled_;
+    }
+    static void Enable() {
+        enabled_ = true;
+        start_ = std::chrono::steady_clock::now();
+    }
+    static void Add(Counter counter, uint64_t value) {
+        if (IsEnabled()) {
+            counters_[static_cast<int32_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+        }
+    }
+    static void AddTime(Stage stage, uint64_t wall_ns, uint64_t cpu_ns) {
+        StageTotals &totals = stages_[static_cast<int32_t>(stage)];
+        totals.calls.fetch_add(1, std::memory_order_relaxed);
+        totals.wall_ns.fetch_add(wall_ns, std::memory_order_relaxed);
+        totals.cpu_ns.fetch_add(cpu_ns, std::memory_order_relaxed);
+    }
+    // Files are kept by member index; the indices of members not coded in this run, such as those already in an
+    // archive that is appended to, stay unnamed and are left out of the report.
+    static void AddFile(size_t index, const std::string &name) {
+        if (not IsEnabled()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (files_.size() <= index) {
+            files_.resize(index + 1);
+        }
+        files_[index].name = name;
+    }
+    // Blocks coded by the calling thread are attributed to this file until the next call.
+    static void SetCurrentFile(int64_t index) {
+        if (IsEnabled()) {
+            current_file_ = index;
+        }
+    }
+    static void AddBlock(const SymbolFrequencies &frequency) {
+        if (not IsEnabled()) {
+            return;
+        }
+        Add(Counter::BLOCKS, 1);
+        if (current_file_ >= 0) {
+            AddFileFrequency(current_file_, frequency);
+        }
+    }
+    // Adds byte counts to a file directly, for blocks shared by several files.
+    static void AddFileFrequency(size_t index, const SymbolFrequencies &frequency) {
+        if (not IsEnabled()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index < files_.size()) {
+            FileTotals &file = files_[index];
+            for (size_t symbol = 0; symbol < file.frequency.size(); ++symbol) {
+                file.frequency[symbol] += frequency[symbol];
+            }
+        }
+    }
+    // Adds the bytes of a Huffman block to the histogram of code lengths.
+    static void AddCodeLengths(const SymbolFrequencies &frequency, const SymbolLengths &code_length) {
+        if (not IsEnabled()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t symbol = 0; symbol < frequency.size(); ++symbol) {
+            if (frequency[symbol] > 0) {
+                code_lengths_[code_length[symbol]] += frequency[symbol];
+            }
+        }
+    }
+    static void AddFileSizes(size_t index, uint64_t original_size, uint64_t encoded_size) {
+        if (not IsEnabled()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index < files_.size()) {
+            files_[index].original_size += original_size;
+            files_[index].encoded_size += encoded_size;
+        }
+    }
+    static void Report(std::ostream &out, bool is_json) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        double user_cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        double system_cpu = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        if (is_json) {
+            ReportJson(out, elapsed, user_cpu, system_cpu);
+        } else {
+            ReportText(out, elapsed, user_cpu, system_cpu);
+        }
+    }
+
+private:
+    struct StageTotals {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> wall_ns;
+        std::atomic<uint64_t> cpu_ns;
+    };
+    struct FileTotals {
+        std::string name;
+        uint64_t original_size = 0;
+        uint64_t encoded_size = 0;
+        std::array<uint64_t, 256> frequency{};
+    };
+
+    // Order-0 entropy of the file in bits per byte, the bound for a single static code over the whole file.
+    static double Entropy(const FileTotals &file) {
+        uint64_t total = 0;
+        for (uint64_t count : file.frequency) {
+            total += count;
+        }
+        double entropy = 0;
+        for (uint64_t count : file.frequency) {
+            if (count > 0) {
+                entropy += count * std::log2(static_cast<double>(total) / count);
+            }
+        }
+        return total > 0 ? entropy / total : 0;
+    }
+    static double BitsPerByte(const FileTotals &file) {
+        return file.original_size > 0 ? 8.0 * file.encoded_size / file.original_size : 0;
+    }
+    static void ReportText(std::ostream &out, double elapsed, double user_cpu, double system_cpu) {
+        out << std::fixed << std::setprecision(3);
+        out << "elapsed " << elapsed << " s, user " << user_cpu << " s, system " << system_cpu << " s\n";
+        out << std::left << std::setw(14) << "stage" << std::right << std::setw(10) << "calls" << std::setw(12)
+            << "wall s" << std::setw(12) << "cpu s" << '\n';
+        for (int32_t i = 0; i < STAGES_COUNT; ++i) {
+            if (stages_[i].calls > 0) {
+                out << std::left << std::setw(14) << STAGE_NAMES[i] << std::right << std::setw(10)
+                    << stages_[i].calls << std::setw(12) << stages_[i].wall_ns / 1e9 << std::setw(12)
+                    << stages_[i].cpu_ns / 1e9 << '\n';
+            }
+        }
+        for (int32_t i = 0; i < COUNTERS_COUNT; ++i) {
+            out << COUNTER_NAMES[i] << ' ' << counters_[i] << '\n';
+        }
+        out << "code length: coded bytes\n";
+        for (size_t length = 1; length < code_lengths_.size(); ++length) {
+            if (code_lengths_[length] > 0) {
+                out << std::setw(4) << length << ": " << code_lengths_[length] << '\n';
+            }
+        }
+        if (not files_.empty()) {
+            out << "entropy and achieved bits per byte\n";
+        }
+        for (const FileTotals &file : files_) {
+            if (file.name.empty()) {
+                continue;
+            }
+            out << std::setw(8) << Entropy(file) << std::setw(8) << BitsPerByte(file) << "  " << file.name << '\n';
+        }
+    }
+    static void ReportJson(std::ostream &out, double elapsed, double user_cpu, double system_cpu) {
+        out << "{\"elapsed_s\": " << elapsed << ", \"user_cpu_s\": " << user_cpu << ", \"system_cpu_s\": "
+            << system_cpu << ", \"stages\": {";
+        bool is_first = true;
+        for (int32_t i = 0; i < STAGES_COUNT; ++i) {
+            if (stages_[i].calls > 0) {
+                out << (is_first ? "" : ", ") << '"' << STAGE_NAMES[i] << "\": {\"calls\": " << stages_[i].calls
+                    << ", \"wall_s\": " << stages_[i].wall_ns / 1e9 << ", \"cpu_s\": " << stages_[i].cpu_ns / 1e9
+                    << '}';
+                is_first = false;
+            }
+        }
+        out << "}, \"counters\": {";
+        for (int32_t i = 0; i < COUNTERS_COUNT; ++i) {
+            out << (i == 0 ? "" : ", ") << '"' << COUNTER_NAMES[i] << "\": " << counters_[i];
+        }
+        out << "}, \"code_lengths\": {";
+        is_first = true;
+        for (size_t length = 1; length < code_lengths_.size(); ++length) {
+            if (code_lengths_[length] > 0) {
+                out << (is_first ? "" : ", ") << '"' << length << "\": " << code_lengths_[length];
+                is_first = false;
+            }
+        }
+        out << "}, \"files\": [";
+        is_first = true;
+        for (const FileTotals &file : files_) {
+            if (file.name.empty()) {
+                continue;
+            }
+            out << (is_first ? "" : ", ") << "{\"name\": \"" << EscapeJson(file.name)
+                << "\", \"original_bytes\": " << file.original_size << ", \"encoded_bytes\": " << file.encoded_size
+                << ", \"entropy_bits_per_byte\": " << Entropy(file) << ", \"achieved_bits_per_byte\": "
+                << BitsPerByte(file) << '}';
+            is_first = false;
+        }
+        out << "]}\n";
+    }
+    static std::string EscapeJson(const std::string &text) {
+        std::string escaped;
+        for (char symbol : text) {
+            if (symbol == '"' or symbol == '\\') {
+                escaped += '\\';
+                escaped += symbol;
+            } else if (static_cast<unsigned char>(symbol) < 0x20) {
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", symbol);
+                escaped += code;
+            } else {
+                escaped += symbol;
+            }
+        }
+        return escaped;
+    }
+
+    inline static bool enabled_ = false;
+    inline static std::chrono::steady_clock::time_point start_;
+    inline static std::array<StageTotals, STAGES_COUNT> stages_;
+    inline static std::array<std::atomic<uint64_t>, COUNTERS_COUNT> counters_;
+    inline static std::array<uint64_t, MAX_CODE_LENGTH + 1> code_lengths_;
+    inline static std::vector<FileTotals> files_;
+    inline static std::mutex mutex_;
+    inline static thread_local int64_t current_file_ = -1;
+};
+
+// Adds the wall and CPU time of its scope to a stage.
+class StageTimer {
+public:
+    explicit StageTimer(Stage stage) : stage_(stage) {
+        if (Statistics::IsEnabled()) {
+            wall_start_ = std::chrono::steady_clock::now();
+            cpu_start_ = ThreadCpuNs();
+        }
+    }
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+    ~StageTimer() {
+        if (Statistics::IsEnabled()) {
+            auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                             wall_start_);
+            Statistics::AddTime(stage_, wall.count(), ThreadCpuNs() - cpu_start_);
+        }
+    }
+
+private:
+    static uint64_t ThreadCpuNs() {
+        struct timespec time;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+    }
+
+    Stage stage_;
+    std::chrono::steady_clock::time_point wall_start_;
+    uint64_t cpu_start_ = 0;
+};
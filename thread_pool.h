@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: every worker owns a deque, takes its newest task first and steals the oldest tasks of the
+// others when its own deque is empty. Tasks submitted from a worker go to that worker's deque, others are spread
+// round-robin. A pool without workers runs every task inside Submit.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads_count) {
+        for (size_t i = 0; i < threads_count; ++i) {
+            queues_.push_back(std::make_unique<WorkQueue>());
+        }
+        for (size_t i = 0; i < threads_count; ++i) {
+            workers_.emplace_back([this, i] { Work(i); });
+        }
+    }
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_up_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+    }
+    size_t Size() const {
+        return workers_.size();
+    }
+    template <typename Task>
+    std::future<void> Submit(Task task) {
+        auto packaged_task = std::make_shared<std::packaged_task<void()>>(std::move(task));
+        std::future<void> result = packaged_task->get_future();
+        if (workers_.empty()) {
+            (*packaged_task)();
+            return result;
+        }
+        size_t index = current_pool_ == this ? current_index_ : next_queue_++ % queues_.size();
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.emplace_back([packaged_task] { (*packaged_task)(); });
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++pending_;
+        }
+        wake_up_.notify_one();
+        return result;
+    }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void Work(size_t index) {
+        current_pool_ = this;
+        current_index_ = index;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_up_.wait(lock, [this] { return stop_ or pending_ > 0; });
+                if (pending_ == 0) {
+                    return;
+                }
+                --pending_;
+            }
+            std::function<void()> task;
+            while (not TakeTask(index, task)) {
+            }
+            task();
+        }
+    }
+    bool TakeTask(size_t index, std::function<void()> &task) {
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            if (not queues_[index]->tasks.empty()) {
+                task = std::move(queues_[index]->tasks.back());
+                queues_[index]->tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t shift = 1; shift < queues_.size(); ++shift) {
+            WorkQueue &victim = *queues_[(index + shift) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (not victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_up_;
+    size_t pending_ = 0;
+    std::atomic<size_t> next_queue_ = 0;
+    bool stop_ = false;
+    inline static thread_local ThreadPool *current_pool_ = nullptr;
+    inline static thread_local size_t current_index_ = 0;
+};